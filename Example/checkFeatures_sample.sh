@@ -0,0 +1,57 @@
+#!/bin/bash
+# checkFeatures_sample.sh checks that the feature vars of the example samples reproduce the baseline version of the macros
+# The reference files atm/nnbar_featurevars_nocut/cut_sample_ref.root are made once with the macros of the baseline commit (the first commit
+# of the repository, or the commit given with -r <commit>) and reused afterwards, -f remakes them
+# The current macros are then run on the samples and compareFeatures.C compares every feature var file to its reference
+# Exits with a non-zero status if a macro fails or any entry differs, e.g. cd Example; ./checkFeatures_sample.sh
+
+set -e
+cd "$(dirname "$0")"
+
+ref_commit=$(git rev-list --max-parents=0 HEAD)
+remake=0
+while getopts "r:f" opt; do
+    case $opt in
+        r) ref_commit=$OPTARG ;;
+        f) remake=1 ;;
+        *) echo "usage: $0 [-r commit] [-f]"; exit 2 ;;
+    esac
+done
+
+files="atm_featurevars_nocut_sample atm_featurevars_cut_sample nnbar_featurevars_nocut_sample nnbar_featurevars_cut_sample"
+macros="calcFeatures_sample.C calcWeights_sample.C cutFeatures_sample.C"
+
+# Reference outputs from the baseline macros, run in a copy of that commit
+missing=0
+for f in $files; do
+    [ -f ${f}_ref.root ] || missing=1
+done
+if [ $remake -eq 1 ] || [ $missing -eq 1 ]; then
+    refdir=$(mktemp -d)
+    trap 'rm -rf "$refdir"' EXIT
+    git archive "$ref_commit" | tar -x -C "$refdir"
+    echo "Making reference files with the macros of $ref_commit"
+    for m in $macros; do
+        (cd "$refdir/Example" && root -l -b -q "$m")
+    done
+    for f in $files; do
+        cp "$refdir/Example/${f}.root" ${f}_ref.root
+    done
+fi
+
+# Outputs of the current macros
+for m in $macros; do
+    root -l -b -q "$m"
+done
+
+status=0
+for f in $files; do
+    echo "Comparing ${f}.root to ${f}_ref.root"
+    root -l -b -q "../compareFeatures.C(\"${f}_ref.root\", \"${f}.root\")" || status=1
+done
+if [ $status -ne 0 ]; then
+    echo "checkFeatures_sample: feature vars differ from the reference"
+else
+    echo "checkFeatures_sample: all feature vars reproduce the reference"
+fi
+exit $status
@@ -0,0 +1,166 @@
+// bdtScorer.h evaluates the AdaBoost BDT trained in classification.ipynb on feature vars in C++
+// The notebook exports the ensemble as flattened node arrays of complete binary trees, shallower branches are padded
+// Node n of a tree has children 2n+1 (x <= threshold) and 2n+2 (x > threshold), the leaves follow the 2^depth-1 nodes
+// Each leaf holds the signed, normalized estimator weight so the score is the sum of one leaf per tree, as clf.decision_function
+// Events are scored in blocks: for each tree every node is compared at once and the leaf is looked up from the comparison bits
+// The block loops have no data-dependent branches and are written to be vectorized by the compiler, blocks are shared out to nthreads threads
+
+#ifndef BDTSCORER_H
+#define BDTSCORER_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <Rtypes.h>
+
+// Events scored together by one thread
+const int kBDTBlock = 256;
+
+// Deepest tree supported, the comparison bits of a tree must fit in 32 bits
+const int kBDTMaxDepth = 5;
+
+// Flattened ensemble, see exportBDT in classification.ipynb for the file format
+struct BDTModel {
+    int depth = 0;
+    int ntrees = 0;
+    std::vector<std::string> features;  // input columns, in the order used by feature
+    std::vector<int> feature;           // [tree][node], index into features
+    std::vector<float> threshold;       // [tree][node], largest float <= the exported threshold
+    std::vector<double> leaf;           // [tree][leaf]
+
+    int numNodes() const { return (1 << depth) - 1; }
+    int numLeaves() const { return 1 << depth; }
+};
+
+// Read an exported model
+// The file is a list of keyword lines: features <n> <names>, depth <d>, ntrees <n>, then per tree
+// the lines feature <2^d-1 ints>, threshold <2^d-1 doubles> and leaf <2^d doubles>, lines starting with # are ignored
+inline bool loadBDTModel(const std::string &fileName, BDTModel &model) {
+    std::ifstream in(fileName);
+    if (!in) {
+        std::cerr << "loadBDTModel: cannot read " << fileName << std::endl;
+        return false;
+    }
+
+    model = BDTModel();
+    std::string key;
+    while (in >> key) {
+        if (key[0] == '#') {
+            std::getline(in, key);
+        } else if (key == "features") {
+            int n;
+            in >> n;
+            model.features.resize(n);
+            for (std::string &name : model.features) in >> name;
+        } else if (key == "depth") {
+            in >> model.depth;
+            if (model.depth < 1 || model.depth > kBDTMaxDepth) {
+                std::cerr << "loadBDTModel: depth " << model.depth << " not supported, at most " << kBDTMaxDepth << std::endl;
+                return false;
+            }
+        } else if (key == "ntrees") {
+            in >> model.ntrees;
+        } else if (key == "feature") {
+            for (int n = 0; n < model.numNodes(); n++) {
+                int f;
+                in >> f;
+                model.feature.push_back(f);
+            }
+        } else if (key == "threshold") {
+            for (int n = 0; n < model.numNodes(); n++) {
+                // sklearn compares float32 inputs to double thresholds, x <= t for a float x is the same as x <= (largest float <= t)
+                double t;
+                in >> t;
+                float tf = (float)t;
+                if ((double)tf > t) tf = std::nextafter(tf, -INFINITY);
+                model.threshold.push_back(tf);
+            }
+        } else if (key == "leaf") {
+            for (int l = 0; l < model.numLeaves(); l++) {
+                double v;
+                in >> v;
+                model.leaf.push_back(v);
+            }
+        } else {
+            std::cerr << "loadBDTModel: unknown keyword " << key << " in " << fileName << std::endl;
+            return false;
+        }
+    }
+
+    bool ok = in.eof() && model.depth > 0 &&
+              model.feature.size() == (size_t)model.ntrees * model.numNodes() &&
+              model.threshold.size() == (size_t)model.ntrees * model.numNodes() &&
+              model.leaf.size() == (size_t)model.ntrees * model.numLeaves();
+    for (int f : model.feature) ok = ok && f >= 0 && f < (int)model.features.size();
+    if (!ok) std::cerr << "loadBDTModel: " << fileName << " is incomplete or inconsistent" << std::endl;
+    return ok;
+}
+
+// Score events [first, first+n) with n <= kBDTBlock, cols[j] is the column of model.features[j]
+// The depth is a template parameter so the node loops unroll and each event of the block is one vector lane
+template <int kDepth>
+inline void scoreBDTBlock(const BDTModel &model, const std::vector<const float*> &cols, Long64_t first, int n, double *score) {
+    const int kNodes = (1 << kDepth) - 1;
+    double acc[kBDTBlock];
+    std::fill(acc, acc + n, 0.0);
+
+    for (int t = 0; t < model.ntrees; t++) {
+        const float *x[kNodes];
+        float cut[kNodes];
+        for (int k = 0; k < kNodes; k++) {
+            x[k] = cols[model.feature[(size_t)t * kNodes + k]] + first;
+            cut[k] = model.threshold[(size_t)t * kNodes + k];
+        }
+        const double *leaf = &model.leaf[(size_t)t * (kNodes + 1)];
+
+        for (int e = 0; e < n; e++) {
+            // Outcome of every node of the tree, bit k is set if the event goes right at node k
+            UInt_t bits = 0;
+            for (int k = 0; k < kNodes; k++) bits |= (UInt_t)(x[k][e] > cut[k]) << k;
+
+            // Follow the path from the root to a leaf using the bits
+            UInt_t node = 0;
+            for (int d = 0; d < kDepth; d++) node = 2*node + 1 + ((bits >> node) & 1u);
+            acc[e] += leaf[node - kNodes];
+        }
+    }
+    std::copy(acc, acc + n, score);
+}
+
+inline void scoreBDTBlock(const BDTModel &model, const std::vector<const float*> &cols, Long64_t first, int n, double *score) {
+    switch (model.depth) {
+        case 1: scoreBDTBlock<1>(model, cols, first, n, score); break;
+        case 2: scoreBDTBlock<2>(model, cols, first, n, score); break;
+        case 3: scoreBDTBlock<3>(model, cols, first, n, score); break;
+        case 4: scoreBDTBlock<4>(model, cols, first, n, score); break;
+        case 5: scoreBDTBlock<5>(model, cols, first, n, score); break;
+    }
+}
+
+// Score all events on nthreads threads (0 uses all cores), cols[j] holds nevents values of model.features[j]
+inline std::vector<double> scoreBDTEvents(const BDTModel &model, const std::vector<const float*> &cols, Long64_t nevents, int nthreads) {
+    std::vector<double> scores(nevents);
+    if (nthreads <= 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+    Long64_t nblocks = (nevents + kBDTBlock - 1) / kBDTBlock;
+    nthreads = std::max<Long64_t>(1, std::min<Long64_t>(nthreads, nblocks));
+
+    std::atomic<Long64_t> next(0);
+    auto worker = [&]() {
+        for (Long64_t b = next++; b < nblocks; b = next++) {
+            Long64_t first = b * kBDTBlock;
+            int n = std::min<Long64_t>(kBDTBlock, nevents - first);
+            scoreBDTBlock(model, cols, first, n, scores.data() + first);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int t = 0; t < nthreads; t++) workers.emplace_back(worker);
+    for (std::thread &t : workers) t.join();
+    return scores;
+}
+
+#endif
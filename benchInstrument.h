@@ -0,0 +1,164 @@
+// benchInstrument.h measures the stages run by benchmark.C
+// Each stage records wall and CPU time, events per second, bytes read from and written to disk, bytes decompressed and peak resident memory
+// Bytes read and written come from the global TFile counters, so they include every file the stage opens on any thread
+// Bytes decompressed are the uncompressed size of the branches the stage reads, see activeBranchBytes()
+// The peak resident memory is reset at the start of each stage through /proc/self/clear_refs, where that fails it is the peak of the process so far
+// Results are appended to a CSV report with one line per stage, the label column tells runs of different versions apart
+
+#ifndef BENCHINSTRUMENT_H
+#define BENCHINSTRUMENT_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <ctime>
+#include <thread>
+#include <sys/resource.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TSystem.h>
+#include <TStopwatch.h>
+
+// Measurements of one stage
+struct StageResult {
+    std::string stage;
+    std::string sample;
+    int nthreads = 1;
+    Long64_t nevents = 0;
+    double wall_s = 0;
+    double cpu_s = 0;            // summed over all threads
+    Long64_t bytes_read = 0;     // compressed, from disk
+    Long64_t bytes_written = 0;
+    Long64_t bytes_unzipped = 0;
+    Long64_t peak_rss_kb = 0;
+
+    double eventsPerSecond() const { return nevents / std::max(wall_s, 1e-9); }
+};
+
+// Peak resident memory of the process in kB, VmHWM follows resetPeakRSS()
+inline Long64_t peakRSS() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return std::stoll(line.substr(6));
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;  // kB on Linux
+}
+
+// Reset the peak resident memory to the current resident memory (Linux 4.0 and later)
+inline bool resetPeakRSS() {
+    std::ofstream clear("/proc/self/clear_refs");
+    clear << "5";
+    clear.flush();
+    return clear.good();
+}
+
+// Compressed and uncompressed size of the enabled branches of a tree
+inline void activeBranchBytes(TTree *tree, Long64_t &zipBytes, Long64_t &totBytes) {
+    zipBytes = 0;
+    totBytes = 0;
+    for (TObject *obj : *tree->GetListOfBranches()) {
+        TBranch *branch = (TBranch*)obj;
+        if (!tree->GetBranchStatus(branch->GetName())) continue;
+        zipBytes += branch->GetZipBytes("*");
+        totBytes += branch->GetTotBytes("*");
+    }
+}
+
+// Uncompressed size of the given branches (wildcards allowed) of a tree in a file, all branches if none are given
+inline Long64_t treeBytes(const std::string &fileName, const std::string &treeName, const std::vector<std::string> &branches = {}) {
+    TFile *infile = TFile::Open(fileName.c_str());
+    if (!infile || infile->IsZombie()) {
+        delete infile;
+        return 0;
+    }
+    TTree *intree = (TTree*)infile->Get(treeName.c_str());
+    Long64_t zipBytes = 0, totBytes = 0;
+    if (intree) {
+        if (!branches.empty()) {
+            intree->SetBranchStatus("*", 0);
+            for (const std::string &name : branches) intree->SetBranchStatus(name.c_str(), 1);
+        }
+        activeBranchBytes(intree, zipBytes, totBytes);
+    }
+    delete infile;
+    return totBytes;
+}
+
+// Times one stage, start() before and stop() after the work
+class StageTimer {
+public:
+    void start() {
+        fPeakReset = resetPeakRSS();
+        fBytesRead = TFile::GetFileBytesRead();
+        fBytesWritten = TFile::GetFileBytesWritten();
+        fTimer.Start();
+    }
+
+    StageResult stop(const std::string &stage, const std::string &sample, int nthreads, Long64_t nevents, Long64_t bytesUnzipped) {
+        fTimer.Stop();
+        StageResult result;
+        result.stage = stage;
+        result.sample = sample;
+        result.nthreads = nthreads;
+        result.nevents = nevents;
+        result.wall_s = fTimer.RealTime();
+        result.cpu_s = fTimer.CpuTime();
+        result.bytes_read = TFile::GetFileBytesRead() - fBytesRead;
+        result.bytes_written = TFile::GetFileBytesWritten() - fBytesWritten;
+        result.bytes_unzipped = bytesUnzipped;
+        result.peak_rss_kb = peakRSS();
+        if (!fPeakReset) std::cerr << "StageTimer: cannot reset the peak memory, " << stage << " reports the peak of the process" << std::endl;
+        return result;
+    }
+
+private:
+    TStopwatch fTimer;
+    Long64_t fBytesRead = 0;
+    Long64_t fBytesWritten = 0;
+    bool fPeakReset = false;
+};
+
+// Print the results as a table
+inline void printStageTable(const std::vector<StageResult> &results) {
+    std::cout << Form("%-10s %-6s %8s %10s %9s %9s %11s %10s %10s %10s %9s", "stage", "sample", "nthreads", "nevents", "wall [s]",
+                      "cpu [s]", "events/s", "read [MB]", "unzip [MB]", "write [MB]", "rss [MB]") << std::endl;
+    for (const StageResult &r : results) {
+        std::cout << Form("%-10s %-6s %8d %10lld %9.3f %9.3f %11.1f %10.1f %10.1f %10.1f %9.1f", r.stage.c_str(), r.sample.c_str(),
+                          r.nthreads, r.nevents, r.wall_s, r.cpu_s, r.eventsPerSecond(), r.bytes_read / 1e6, r.bytes_unzipped / 1e6,
+                          r.bytes_written / 1e6, r.peak_rss_kb / 1024.) << std::endl;
+    }
+}
+
+// Append the results to a CSV report, the header is written when the file is new
+// label names the version under test (e.g. a git commit), dataset describes the input and must not contain commas
+inline bool appendReport(const std::string &fileName, const std::string &label, const std::string &dataset,
+                         const std::vector<StageResult> &results) {
+    bool isNew = gSystem->AccessPathName(fileName.c_str());  // kTRUE if missing
+    std::ofstream report(fileName, std::ios::app);
+    if (!report) {
+        std::cerr << "appendReport: cannot write " << fileName << std::endl;
+        return false;
+    }
+    if (isNew) {
+        report << "label,date,host,cores,dataset,stage,sample,nthreads,nevents,wall_s,cpu_s,events_per_s,"
+                  "bytes_read,bytes_written,bytes_unzipped,peak_rss_kb\n";
+    }
+
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+    for (const StageResult &r : results) {
+        report << label << "," << date << "," << gSystem->HostName() << "," << std::thread::hardware_concurrency() << ","
+               << dataset << "," << r.stage << "," << r.sample << "," << r.nthreads << "," << r.nevents << ","
+               << r.wall_s << "," << r.cpu_s << "," << r.eventsPerSecond() << ","
+               << r.bytes_read << "," << r.bytes_written << "," << r.bytes_unzipped << "," << r.peak_rss_kb << "\n";
+    }
+    return report.good();
+}
+
+#endif
@@ -0,0 +1,434 @@
+// featureCache.h keeps the feature vars of every input file in a cache directory so unchanged inputs are not read again
+// Each input file is keyed by a hash of its content (and the tree name), each feature var by the version of its definition
+// The cache file <cacheDir>/<key>.root holds one single-branch tree per feature var, named after the branch and titled v<version>
+// Only input files with a missing or outdated column are read, and only those columns are rewritten
+// runCachedFeatures() hands back the joined columns of all files in input order, the same rows a full calcFeatures.C pass gives
+// calcSampleFeatures() is the per-sample body of calcFeatures.C, also called by benchmark.C
+// Fresh rows are filled into the column trees as they stream in, so memory does not grow with the size of the inputs
+// Content hashes are stored in <cacheDir>/manifest.txt with the file size and modification time, files are only rehashed when these change
+// The manifest also holds the number of entries of each input, a column is only used if it has exactly that many rows
+// The manifest is only updated after a successful run, columns written by a failed run are removed again
+
+#ifndef FEATURECACHE_H
+#define FEATURECACHE_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <sys/stat.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TSystem.h>
+#include "featureEngine.h"
+
+// Definition version of each feature var, in the kFeatureNames order
+// Bump the version of a feature var whenever its calculation changes, only that column is then recomputed
+const int kFeatureVersions[kNumFeatureVars] = {1, 1, 1, 1, 1,
+                                               1, 1, 1, 1, 1,
+                                               1, 1, 1, 1, 1};
+
+// 64-bit hash of a byte range, used to detect changed inputs (not cryptographic)
+inline ULong64_t hashBytes(const char *data, size_t n, ULong64_t h) {
+    const ULong64_t mult = 0x9E3779B97F4A7C15ULL;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        ULong64_t w;
+        std::memcpy(&w, data + i, 8);
+        h = (h ^ w) * mult;
+        h ^= h >> 32;
+    }
+    for (; i < n; i++) {
+        h = (h ^ (unsigned char)data[i]) * mult;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+// Hash of the full content of a local file, false if it cannot be read
+inline bool hashFileContent(const std::string &name, ULong64_t &hash) {
+    std::ifstream in(name, std::ios::binary);
+    if (!in) return false;
+    std::vector<char> block(1 << 20);
+    ULong64_t h = 0xCBF29CE484222325ULL;
+    Long64_t total = 0;
+    while (in) {
+        in.read(block.data(), block.size());
+        std::streamsize n = in.gcount();
+        if (n <= 0) break;
+        h = hashBytes(block.data(), n, h);
+        total += n;
+    }
+    hash = hashBytes((const char*)&total, sizeof(total), h);
+    return true;
+}
+
+// Size and modification time of a local file, false for remote or missing files
+inline bool fileStamp(const std::string &name, Long64_t &size, Long64_t &mtime) {
+    struct stat st;
+    if (stat(name.c_str(), &st) != 0) return false;
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+class FeatureCache {
+public:
+    explicit FeatureCache(const std::string &dir) : fDir(dir) {
+        gSystem->mkdir(fDir.c_str(), true);
+        std::ifstream manifest(manifestName());
+        std::string line;
+        if (!std::getline(manifest, line) || line != kManifestHeader) return;  // missing or older manifest, every input is rehashed
+        while (std::getline(manifest, line)) {
+            std::stringstream ss(line);
+            Stamp stamp;
+            std::string name;
+            ss >> std::hex >> stamp.hash >> std::dec >> stamp.size >> stamp.mtime >> stamp.nentries;
+            std::getline(ss >> std::ws, name);
+            if (!name.empty()) fStamps[name] = stamp;
+        }
+    }
+
+    // Cache key of each input file, empty for files that cannot be hashed (e.g. remote files), these are never cached
+    // Files that changed since the last run are hashed on nthreads threads, the manifest is written by saveManifest()
+    std::vector<std::string> keyFiles(const std::vector<std::string> &files, const std::string &treeName, int nthreads) {
+        std::vector<Stamp> stamps(files.size());
+        std::vector<char> ok(files.size(), 0);
+        std::vector<size_t> todo;
+        for (size_t i = 0; i < files.size(); i++) {
+            Stamp &s = stamps[i];
+            if (!fileStamp(files[i], s.size, s.mtime)) continue;
+            auto it = fStamps.find(files[i]);
+            if (it != fStamps.end() && it->second.size == s.size && it->second.mtime == s.mtime) {
+                s.hash = it->second.hash;
+                ok[i] = 1;
+            } else {
+                todo.push_back(i);
+            }
+        }
+
+        if (nthreads <= 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+        std::atomic<size_t> next(0);
+        auto worker = [&]() {
+            for (size_t t = next++; t < todo.size(); t = next++) {
+                ok[todo[t]] = hashFileContent(files[todo[t]], stamps[todo[t]].hash);
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int t = 0; t < std::min<int>(nthreads, todo.size()); t++) workers.emplace_back(worker);
+        for (std::thread &t : workers) t.join();
+        fNumHashed += todo.size();
+
+        std::vector<std::string> keys(files.size());
+        for (size_t i = 0; i < files.size(); i++) {
+            if (!ok[i]) continue;
+            // The number of entries is kept only while the content is the same
+            auto it = fStamps.find(files[i]);
+            if (it != fStamps.end() && it->second.hash == stamps[i].hash) stamps[i].nentries = it->second.nentries;
+            fStamps[files[i]] = stamps[i];
+            ULong64_t key = hashBytes(treeName.data(), treeName.size(), stamps[i].hash);
+            keys[i] = Form("%016llx", (unsigned long long)key);
+        }
+        return keys;
+    }
+
+    // Number of entries of an input file recorded by an earlier run, -1 if unknown
+    Long64_t entries(const std::string &file) const {
+        auto it = fStamps.find(file);
+        return (it != fStamps.end()) ? it->second.nentries : -1;
+    }
+
+    // Record the number of entries of an input file, written with the next saveManifest()
+    void setEntries(const std::string &file, Long64_t nentries) {
+        auto it = fStamps.find(file);
+        if (it != fStamps.end()) it->second.nentries = nentries;
+    }
+
+    // Columns of a key that are missing, were written with an older definition or do not have nentries rows
+    // All columns are stale if the number of entries is unknown (nentries < 0)
+    std::vector<int> staleColumns(const std::string &key, Long64_t nentries) const {
+        std::vector<int> stale;
+        TFile *cachefile = (nentries >= 0) ? openColumns(key, "READ") : nullptr;
+        for (int v = 0; v < kNumFeatureVars; v++) {
+            TTree *coltree = cachefile ? (TTree*)cachefile->Get(kFeatureNames[v]) : nullptr;
+            if (!coltree || std::string(coltree->GetTitle()) != Form("v%d", kFeatureVersions[v]) || coltree->GetEntries() != nentries) {
+                stale.push_back(v);
+            }
+        }
+        delete cachefile;
+        return stale;
+    }
+
+    // Remove columns of a key, used to drop the columns of a failed run
+    void dropColumns(const std::string &key, const std::vector<int> &columns) const {
+        if (gSystem->AccessPathName((fDir + "/" + key + ".root").c_str())) return;  // kTRUE if missing
+        TFile *cachefile = openColumns(key, "UPDATE");
+        if (!cachefile) return;
+        for (int v : columns) cachefile->Delete(Form("%s;*", kFeatureNames[v]));
+        delete cachefile;
+    }
+
+    // Overwrites the given columns of a key with freshly calculated rows, one fill() per row and finish() after the last one
+    // The column trees are filled in the cache file, so full baskets go to disk instead of staying in memory
+    class ColumnWriter {
+    public:
+        ColumnWriter(FeatureCache &cache, const std::string &key, const std::vector<int> &columns) : fCache(cache), fNumColumns(columns.size()) {
+            fCacheFile = cache.openColumns(key, "UPDATE");
+            if (!fCacheFile) {
+                std::cerr << "featureCache: cannot write columns for key " << key << " to " << cache.fDir << std::endl;
+                return;
+            }
+            for (int v : columns) {
+                TTree *coltree = new TTree(kFeatureNames[v], Form("v%d", kFeatureVersions[v]));
+                coltree->Branch(kFeatureNames[v], featureAddress(fFv, v), Form("%s/%s", kFeatureNames[v], (v < kNumShortFeatureVars) ? "S" : "F"));
+                fColTrees.push_back(coltree);
+            }
+        }
+        ColumnWriter(const ColumnWriter&) = delete;
+        ColumnWriter &operator=(const ColumnWriter&) = delete;
+        ~ColumnWriter() { finish(); }
+
+        void fill(const FeatureVars &row) {
+            fFv = row;
+            for (TTree *coltree : fColTrees) coltree->Fill();
+        }
+
+        // Drop the rows filled so far without writing the columns
+        void discard() {
+            for (TTree *coltree : fColTrees) delete coltree;
+            fColTrees.clear();
+            delete fCacheFile;
+            fCacheFile = nullptr;
+        }
+
+        void finish() {
+            if (!fCacheFile) return;
+            fCacheFile->cd();
+            for (TTree *coltree : fColTrees) {
+                coltree->Write("", TObject::kOverwrite);
+                delete coltree;
+            }
+            fColTrees.clear();
+            delete fCacheFile;
+            fCacheFile = nullptr;
+            fCache.fNumColumnsWritten += fNumColumns;
+        }
+
+    private:
+        FeatureCache &fCache;
+        size_t fNumColumns;
+        TFile *fCacheFile = nullptr;
+        std::vector<TTree*> fColTrees;
+        FeatureVars fFv;
+    };
+
+    // Join the cached columns of a key and pass every row to sink, returns the number of rows
+    // Returns -1 before passing any row if a column is missing or does not have nentries rows
+    template <typename Sink>
+    Long64_t readColumns(const std::string &key, Long64_t nentries, Sink sink) const {
+        TFile *cachefile = openColumns(key, "READ");
+        if (!cachefile) {
+            std::cerr << "featureCache: cannot read columns for key " << key << std::endl;
+            return -1;
+        }
+        FeatureVars fv;
+        TTree *coltree[kNumFeatureVars];
+        for (int v = 0; v < kNumFeatureVars; v++) {
+            coltree[v] = (TTree*)cachefile->Get(kFeatureNames[v]);
+            if (!coltree[v] || coltree[v]->GetEntries() != nentries) {
+                std::cerr << "featureCache: column " << kFeatureNames[v] << " for key " << key << " is missing or does not have "
+                          << nentries << " rows" << std::endl;
+                delete cachefile;
+                return -1;
+            }
+            coltree[v]->SetBranchAddress(kFeatureNames[v], featureAddress(fv, v));
+        }
+        Long64_t nrows = nentries;
+        for (Long64_t en = 0; en < nrows; en++) {
+            for (int v = 0; v < kNumFeatureVars; v++) coltree[v]->GetEntry(en);
+            sink(fv);
+        }
+        delete cachefile;
+        return nrows;
+    }
+
+    Long64_t numHashed() const { return fNumHashed; }
+    Long64_t numColumnsWritten() const { return fNumColumnsWritten; }
+
+    void saveManifest() const {
+        std::ofstream manifest(manifestName());
+        manifest << kManifestHeader << "\n";
+        for (const auto &entry : fStamps) {
+            manifest << Form("%016llx", (unsigned long long)entry.second.hash) << " " << entry.second.size << " "
+                     << entry.second.mtime << " " << entry.second.nentries << " " << entry.first << "\n";
+        }
+    }
+
+private:
+    struct Stamp {
+        ULong64_t hash = 0;
+        Long64_t size = 0;
+        Long64_t mtime = 0;
+        Long64_t nentries = -1;
+    };
+
+    static constexpr const char *kManifestHeader = "# featureCache manifest v2: hash size mtime nentries file";
+
+    std::string fDir;
+    std::map<std::string, Stamp> fStamps;
+    Long64_t fNumHashed = 0;
+    Long64_t fNumColumnsWritten = 0;
+
+    std::string manifestName() const { return fDir + "/manifest.txt"; }
+
+    TFile *openColumns(const std::string &key, const char *option) const {
+        std::string name = fDir + "/" + key + ".root";
+        if (std::string(option) == "READ" && gSystem->AccessPathName(name.c_str())) return nullptr;  // kTRUE if missing
+        TFile *cachefile = TFile::Open(name.c_str(), option);
+        if (!cachefile || cachefile->IsZombie()) {
+            delete cachefile;
+            return nullptr;
+        }
+        return cachefile;
+    }
+};
+
+// Feature vars of all files through the cache, rows are passed to sink in input order
+// Files with stale columns are read with runEventLoop(), all columns are recalculated but only the stale ones are written
+// The feature vars of an event share one particle list, so recalculating a single column costs the same input read as all of them
+// Cached files are read back between the fresh ones as the event loop reaches them, so no rows are buffered here
+// Returns -1 if the event loop or a cached file fails, the columns written by this call are then removed and the manifest is kept
+inline Long64_t runCachedFeatures(const std::vector<std::string> &files, const std::string &treeName, const std::string &cacheDir,
+                                  int nthreads, const std::function<void(const FeatureVars&)> &sink) {
+    FeatureCache cache(cacheDir);
+    std::vector<std::string> keys = cache.keyFiles(files, treeName, nthreads);
+
+    // Find the files that have to be read
+    std::vector<std::vector<int>> stale(files.size());
+    std::vector<std::string> toRead;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (keys[i].empty()) {
+            stale[i].resize(kNumFeatureVars);
+            for (int v = 0; v < kNumFeatureVars; v++) stale[i][v] = v;
+        } else {
+            stale[i] = cache.staleColumns(keys[i], cache.entries(files[i]));
+        }
+        if (!stale[i].empty()) toRead.push_back(files[i]);
+    }
+
+    // Entry ranges of the files to read, files that could not be opened are left out
+    std::vector<InputFileInfo> infos;
+    std::vector<EntryRange> ranges;
+    planEntryRanges(toRead, treeName, infos, ranges);
+    std::vector<size_t> infoFile;
+    size_t file_i = 0;
+    for (const InputFileInfo &info : infos) {
+        while (files[file_i] != info.name || stale[file_i].empty()) file_i++;
+        infoFile.push_back(file_i++);
+    }
+
+    // Hand the cached files before file end to the sink, stops at the first file that cannot be read
+    Long64_t nrows = 0;
+    size_t next_file = 0;
+    bool failed = false;
+    auto readCachedUpTo = [&](size_t end) {
+        for (; next_file < end && !failed; next_file++) {
+            if (!stale[next_file].empty()) continue;
+            Long64_t n = cache.readColumns(keys[next_file], cache.entries(files[next_file]), sink);
+            if (n < 0) failed = true;
+            else nrows += n;
+        }
+    };
+
+    // Fresh rows arrive in input order, each is written to the stale columns of its file and passed on
+    size_t info_i = 0;
+    Long64_t rows_left = 0;
+    std::unique_ptr<FeatureCache::ColumnWriter> writer;
+    std::vector<size_t> written;  // files whose columns were (re)written, dropped again if the run fails
+    auto startFile = [&]() {
+        writer.reset();
+        size_t i = infoFile[info_i];
+        rows_left = infos[info_i].nentries;
+        info_i++;
+        readCachedUpTo(i);
+        next_file = i + 1;
+        if (!keys[i].empty() && !failed) {
+            writer.reset(new FeatureCache::ColumnWriter(cache, keys[i], stale[i]));
+            written.push_back(i);
+        }
+    };
+    Long64_t nevents = runEventLoop<FeatureVars>(infos, ranges, treeName, nthreads,
+        [](EventBuffers &b, FeatureVars &row) { calcEventFeatures(b, row); },
+        [&](const FeatureVars &row) {
+            while (rows_left == 0) startFile();
+            if (failed) return;
+            if (writer) writer->fill(row);
+            sink(row);
+            nrows++;
+            rows_left--;
+        });
+    if (nevents < 0) failed = true;
+
+    // Files without entries at the end still get their (empty) columns, then the remaining cached files follow
+    while (!failed && info_i < infos.size()) startFile();
+    if (!failed) {
+        writer.reset();
+        readCachedUpTo(files.size());
+    }
+    if (failed) {
+        if (writer) writer->discard();
+        writer.reset();
+        for (size_t i : written) cache.dropColumns(keys[i], stale[i]);
+        std::cerr << "featureCache: run failed, the columns written by it were removed from " << cacheDir << std::endl;
+        return -1;
+    }
+
+    // Only a complete run records the number of entries of the read files, which makes their columns valid
+    for (size_t k = 0; k < infos.size(); k++) cache.setEntries(files[infoFile[k]], infos[k].nentries);
+    cache.saveManifest();
+
+    std::cout << "featureCache: " << files.size() << " files, " << cache.numHashed() << " hashed, " << toRead.size() << " read, "
+              << cache.numColumnsWritten() << " columns written to " << cacheDir << std::endl;
+    return nrows;
+}
+
+// calcFeatures.C for one sample: the feature vars of all files are written to the tree "feats" of outFileName
+// With a cacheDir the rows come through runCachedFeatures(), otherwise straight from runEventLoop(), returns the number of events
+inline Long64_t calcSampleFeatures(const std::vector<std::string> &files, const std::string &treeName, const std::string &outFileName,
+                                   const std::string &id, int nthreads, const std::string &cacheDir = "") {
+    // Create new file for calculated feature variables
+    TFile *varfile = new TFile(outFileName.c_str(), "RECREATE");
+    TTree *vartree = new TTree("feats", Form("%s feature vars no cuts applied", id.c_str()));
+
+    // Define feature vars and add branches
+    FeatureVars fv;
+    branchFeatureVars(vartree, fv);
+
+    // Loop over all events
+    auto fill = [&](const FeatureVars &row) { fv = row; vartree->Fill(); };
+    Long64_t nevents;
+    if (!cacheDir.empty()) {
+        nevents = runCachedFeatures(files, treeName, cacheDir, nthreads, fill);
+    } else {
+        // Split the input files into entry ranges for the workers
+        std::vector<InputFileInfo> infos;
+        std::vector<EntryRange> ranges;
+        planEntryRanges(files, treeName, infos, ranges);
+        nevents = runEventLoop<FeatureVars>(infos, ranges, treeName, nthreads,
+            [](EventBuffers &b, FeatureVars &row) { calcEventFeatures(b, row); }, fill);
+    }
+
+    // Write the new tree to the file
+    varfile->Write();
+    delete varfile;
+    return nevents;
+}
+
+#endif
@@ -0,0 +1,602 @@
+// featureEngine.h holds the event loop shared by the feature macros
+// Input files are split into cluster-aligned entry ranges that are handed out to worker threads
+// Each worker has its own file handle, branch buffers and output chunk
+// Chunks are handed back to the calling thread in input order so output trees keep the same entry order as a serial pass
+
+#ifndef FEATUREENGINE_H
+#define FEATUREENGINE_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <TROOT.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TChain.h>
+#include "featureKernel.h"
+
+// Clusters are merged until a task holds at least this many entries
+const Long64_t kMinTaskEntries = 500;
+
+// Feature vars written to the feats tree
+struct FeatureVars {
+    Short_t num_particles;
+    Short_t num_showers;
+    Short_t num_tracks;
+    Short_t num_p;
+    Short_t num_mu;
+    Float_t trk_vis_eng;
+    Float_t shwr_vis_eng;
+    Float_t tot_vis_eng;
+    Float_t tot_momentum;
+    Float_t inv_mass;
+    Float_t sphericity;
+    Float_t aplanarity;
+    Float_t FW0;
+    Float_t FW1;
+    Float_t FW2;
+};
+
+// Add branches for feature vars
+inline void branchFeatureVars(TTree *vartree, FeatureVars &fv) {
+    vartree->Branch("num_particles", &fv.num_particles);
+    vartree->Branch("num_showers", &fv.num_showers);
+    vartree->Branch("num_tracks", &fv.num_tracks);
+    vartree->Branch("num_p", &fv.num_p);
+    vartree->Branch("num_mu", &fv.num_mu);
+    vartree->Branch("trk_eng", &fv.trk_vis_eng);
+    vartree->Branch("shwr_eng", &fv.shwr_vis_eng);
+    vartree->Branch("visible_energy", &fv.tot_vis_eng);
+    vartree->Branch("tot_momentum", &fv.tot_momentum);
+    vartree->Branch("invariant_mass", &fv.inv_mass);
+    vartree->Branch("sphericity", &fv.sphericity);
+    vartree->Branch("aplanarity", &fv.aplanarity);
+    vartree->Branch("FW0", &fv.FW0);
+    vartree->Branch("FW1", &fv.FW1);
+    vartree->Branch("FW2", &fv.FW2);
+}
+
+// Read feature vars from an existing feats tree
+inline void setFeatureVarsAddress(TTree *vartree, FeatureVars &fv) {
+    vartree->SetBranchAddress("num_particles", &fv.num_particles);
+    vartree->SetBranchAddress("num_showers", &fv.num_showers);
+    vartree->SetBranchAddress("num_tracks", &fv.num_tracks);
+    vartree->SetBranchAddress("num_p", &fv.num_p);
+    vartree->SetBranchAddress("num_mu", &fv.num_mu);
+    vartree->SetBranchAddress("trk_eng", &fv.trk_vis_eng);
+    vartree->SetBranchAddress("shwr_eng", &fv.shwr_vis_eng);
+    vartree->SetBranchAddress("visible_energy", &fv.tot_vis_eng);
+    vartree->SetBranchAddress("tot_momentum", &fv.tot_momentum);
+    vartree->SetBranchAddress("invariant_mass", &fv.inv_mass);
+    vartree->SetBranchAddress("sphericity", &fv.sphericity);
+    vartree->SetBranchAddress("aplanarity", &fv.aplanarity);
+    vartree->SetBranchAddress("FW0", &fv.FW0);
+    vartree->SetBranchAddress("FW1", &fv.FW1);
+    vartree->SetBranchAddress("FW2", &fv.FW2);
+}
+
+// Branch names of the feature vars, in the order used by featureValues()
+const int kNumFeatureVars = 15;
+const char *const kFeatureNames[kNumFeatureVars] = {"num_particles", "num_showers", "num_tracks", "num_p", "num_mu",
+                                                    "trk_eng", "shwr_eng", "visible_energy", "tot_momentum", "invariant_mass",
+                                                    "sphericity", "aplanarity", "FW0", "FW1", "FW2"};
+
+inline void featureValues(const FeatureVars &fv, double vals[kNumFeatureVars]) {
+    vals[0] = fv.num_particles; vals[1] = fv.num_showers; vals[2] = fv.num_tracks; vals[3] = fv.num_p; vals[4] = fv.num_mu;
+    vals[5] = fv.trk_vis_eng; vals[6] = fv.shwr_vis_eng; vals[7] = fv.tot_vis_eng; vals[8] = fv.tot_momentum; vals[9] = fv.inv_mass;
+    vals[10] = fv.sphericity; vals[11] = fv.aplanarity; vals[12] = fv.FW0; vals[13] = fv.FW1; vals[14] = fv.FW2;
+}
+
+// Address of feature var i in the same order, the first kNumShortFeatureVars are Short_t and the rest Float_t
+const int kNumShortFeatureVars = 5;
+
+inline void *featureAddress(FeatureVars &fv, int i) {
+    void *addr[kNumFeatureVars] = {&fv.num_particles, &fv.num_showers, &fv.num_tracks, &fv.num_p, &fv.num_mu,
+                                   &fv.trk_vis_eng, &fv.shwr_vis_eng, &fv.tot_vis_eng, &fv.tot_momentum, &fv.inv_mass,
+                                   &fv.sphericity, &fv.aplanarity, &fv.FW0, &fv.FW1, &fv.FW2};
+    return addr[i];
+}
+
+// Expand an input spec into a list of file names
+// A spec may be a single file, a comma separated list, a wildcard pattern (e.g. "/data/atm_*.root")
+// or a .txt/.list file with one file or pattern per line (lines starting with # are ignored)
+inline std::vector<std::string> expandInputFiles(const std::string &spec, const std::string &treeName) {
+    std::vector<std::string> files;
+
+    std::string item;
+    std::stringstream ss(spec);
+    while (std::getline(ss, item, ',')) {
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t\r") + 1);
+        if (item.empty() || item[0] == '#') continue;
+
+        bool isList = (item.size() > 4 && item.compare(item.size() - 4, 4, ".txt") == 0) ||
+                      (item.size() > 5 && item.compare(item.size() - 5, 5, ".list") == 0);
+        if (isList) {
+            std::ifstream listfile(item);
+            if (!listfile) {
+                std::cerr << "expandInputFiles: cannot read file list " << item << std::endl;
+                continue;
+            }
+            std::string line;
+            while (std::getline(listfile, line)) {
+                std::vector<std::string> sub = expandInputFiles(line, treeName);
+                files.insert(files.end(), sub.begin(), sub.end());
+            }
+            continue;
+        }
+
+        // TChain takes care of wildcard expansion
+        TChain chain(treeName.c_str());
+        chain.Add(item.c_str());
+        for (TObject *elem : *chain.GetListOfFiles()) {
+            files.push_back(elem->GetTitle());
+        }
+    }
+    return files;
+}
+
+// Per file bookkeeping from the planning pass
+struct InputFileInfo {
+    std::string name;
+    Long64_t nentries;
+    bool skim;      // skimmed tree written by skimTrees.C
+    int maxPFP;
+    int max_ktrk;
+    int max_kshwr;
+    int max_hits;   // wires per plane of the raw hit arrays, or the largest number of hits per event in a skim
+    int max_knuvtx; // 0 if the tree has no truth neutrino vertex
+};
+
+// Contiguous range of entries [first, last) in one input file
+struct EntryRange {
+    int file;
+    Long64_t first;
+    Long64_t last;
+};
+
+// Skimmed trees carry the hits of the selected plane only, see skimTrees.C
+inline bool isSkimTree(TTree *intree) {
+    return intree->GetBranch("trkdedx_skim") != nullptr;
+}
+
+// Open every input file once to find entry counts and array maxima, and split them into cluster-aligned ranges
+inline void planEntryRanges(const std::vector<std::string> &files, const std::string &treeName,
+                            std::vector<InputFileInfo> &infos, std::vector<EntryRange> &ranges) {
+    for (const std::string &name : files) {
+        TFile *infile = TFile::Open(name.c_str());
+        if (!infile || infile->IsZombie()) {
+            std::cerr << "planEntryRanges: cannot open " << name << ", skipping" << std::endl;
+            delete infile;
+            continue;
+        }
+        TTree *intree = (TTree*)infile->Get(treeName.c_str());
+        if (!intree) {
+            std::cerr << "planEntryRanges: no tree " << treeName << " in " << name << ", skipping" << std::endl;
+            delete infile;
+            continue;
+        }
+
+        InputFileInfo info;
+        info.name = name;
+        info.nentries = intree->GetEntries();
+        info.skim = isSkimTree(intree);
+        info.maxPFP = intree->GetMaximum("nPFParticles");
+        info.max_ktrk = intree->GetMaximum("ntracks_pandoraTrack");
+        info.max_kshwr = intree->GetMaximum("nshowers_pandoraShower");
+        if (info.skim) {
+            info.max_hits = intree->GetMaximum("nskimhits");
+        } else {
+            info.max_hits = intree->GetLeaf("trkdedx_pandoraTrack")->GetLenStatic() / 3;
+        }
+        info.max_knuvtx = intree->GetBranch("nuvtxx_truth") ? intree->GetMaximum("nnuvtx") : 0;
+        int file_i = infos.size();
+        infos.push_back(info);
+
+        // Merge clusters until each range is large enough to be worth a task
+        TTree::TClusterIterator clusters = intree->GetClusterIterator(0);
+        Long64_t start;
+        Long64_t rangeStart = 0;
+        while ((start = clusters.Next()) < info.nentries) {
+            Long64_t end = std::min(clusters.GetNextEntry(), info.nentries);
+            if (end - rangeStart >= kMinTaskEntries) {
+                ranges.push_back({file_i, rangeStart, end});
+                rangeStart = end;
+            }
+        }
+        if (rangeStart < info.nentries) ranges.push_back({file_i, rangeStart, info.nentries});
+
+        delete infile;
+    }
+}
+
+// Branch buffers for one reader, allocated on the heap from the array maxima of all inputs
+// Multi-dimensional branches are stored flat, use the index helpers below
+// Raw trees fill trk_dedx_reco and trk_xyz for all planes, skims fill the skim_* hit arrays of the selected plane
+struct EventBuffers {
+    Short_t kPFP;
+    Short_t ktrk;
+    Short_t kshwr;
+
+    std::vector<Short_t> is_trk;
+    std::vector<Short_t> trk_bestplane;
+    std::vector<Float_t> trk_pida;          // [track][plane]
+    std::vector<Short_t> ktrkhits;          // [track][plane]
+    std::vector<Float_t> trk_momrange_reco;
+    std::vector<Float_t> trk_start_xhat;
+    std::vector<Float_t> trk_start_yhat;
+    std::vector<Float_t> trk_start_zhat;
+
+    // Raw hit arrays
+    int nwires;                             // wires per plane
+    std::vector<Float_t> trk_dedx_reco;     // [track][plane][wire]
+    std::vector<Float_t> trk_xyz;           // [track][plane][wire][x,y,z]
+
+    // Skimmed hit arrays
+    bool skim;
+    Int_t nskimhits;
+    std::vector<Short_t> skim_hitplane;     // [track]
+    std::vector<Short_t> skim_nhits;        // [track]
+    std::vector<Float_t> skim_dedx;         // [hit]
+    std::vector<Float_t> skim_xyz;          // [hit][x,y,z]
+    std::vector<Int_t> skim_offset;         // first hit of each track, filled by prepare()
+
+    std::vector<Short_t> is_shwr;
+    std::vector<Short_t> shwr_bestplane;
+    std::vector<Float_t> shwr_totEng_reco;  // [shower][plane]
+    std::vector<Float_t> shwr_start_xhat;
+    std::vector<Float_t> shwr_start_yhat;
+    std::vector<Float_t> shwr_start_zhat;
+
+    // Truth neutrino vertices, only read when readVertex is set
+    bool readVertex;
+    Short_t nnuvtx;
+    std::vector<Float_t> nuvtxx;
+    std::vector<Float_t> nuvtxy;
+    std::vector<Float_t> nuvtxz;
+
+    // Scratch list of accepted particles for the kinematics kernel
+    ParticleList particles;
+
+    // Size the buffers for all files in infos, hit buffers are only allocated for the formats present
+    EventBuffers(const std::vector<InputFileInfo> &infos) : kPFP(0), ktrk(0), kshwr(0), nwires(0), skim(false), nskimhits(0), readVertex(false), nnuvtx(0) {
+        int maxPFP = 1, max_ktrk = 1, max_kshwr = 1, max_skimhits = 1, max_knuvtx = 1;
+        for (const InputFileInfo &info : infos) {
+            maxPFP = std::max(maxPFP, info.maxPFP);
+            max_ktrk = std::max(max_ktrk, info.max_ktrk);
+            max_kshwr = std::max(max_kshwr, info.max_kshwr);
+            max_knuvtx = std::max(max_knuvtx, info.max_knuvtx);
+            if (info.skim) max_skimhits = std::max(max_skimhits, info.max_hits);
+            else nwires = std::max(nwires, info.max_hits);
+        }
+
+        is_trk.resize(maxPFP);
+        trk_bestplane.resize(max_ktrk);
+        trk_pida.resize(max_ktrk*3);
+        ktrkhits.resize(max_ktrk*3);
+        trk_momrange_reco.resize(max_ktrk);
+        trk_start_xhat.resize(max_ktrk);
+        trk_start_yhat.resize(max_ktrk);
+        trk_start_zhat.resize(max_ktrk);
+
+        trk_dedx_reco.resize((size_t)max_ktrk*3*nwires);
+        trk_xyz.resize((size_t)max_ktrk*3*nwires*3);
+
+        skim_hitplane.resize(max_ktrk);
+        skim_nhits.resize(max_ktrk);
+        skim_offset.resize(max_ktrk);
+        skim_dedx.resize(max_skimhits);
+        skim_xyz.resize((size_t)max_skimhits*3);
+
+        is_shwr.resize(maxPFP);
+        shwr_bestplane.resize(max_kshwr);
+        shwr_totEng_reco.resize(max_kshwr*3);
+        shwr_start_xhat.resize(max_kshwr);
+        shwr_start_yhat.resize(max_kshwr);
+        shwr_start_zhat.resize(max_kshwr);
+
+        nuvtxx.resize(max_knuvtx);
+        nuvtxy.resize(max_knuvtx);
+        nuvtxz.resize(max_knuvtx);
+
+        particles.reserve(std::max(max_ktrk, max_kshwr));
+    }
+
+    float pida(int itrk, int plane) const { return trk_pida[itrk*3 + plane]; }
+    float shwrEng(int ishwr, int plane) const { return shwr_totEng_reco[ishwr*3 + plane]; }
+
+    // Plane used for the track PID and the shower energy, -1 if the best plane is not 0-2
+    Short_t pidPlane(int itrk) const {
+        Short_t plane = (pida(itrk, 2) > 0) ? 2 : trk_bestplane[itrk];
+        return (plane >= 0 && plane < 3) ? plane : -1;
+    }
+    Short_t shwrPlane(int ishwr) const {
+        Short_t plane = (shwrEng(ishwr, 2) > 0) ? 2 : shwr_bestplane[ishwr];
+        return (plane >= 0 && plane < 3) ? plane : -1;
+    }
+
+    // Plane whose hits are used for the track calorimetry, -1 if there is none
+    Short_t hitPlane(int itrk) const {
+        if (skim) return skim_hitplane[itrk];
+        Short_t plane = (trk_dedx_reco[((size_t)itrk*3 + 2)*nwires] > 0) ? 2 : trk_bestplane[itrk];
+        return (plane >= 0 && plane < 3) ? plane : -1;
+    }
+    int hitCount(int itrk) const {
+        if (skim) return skim_nhits[itrk];
+        Short_t plane = hitPlane(itrk);
+        return (plane < 0) ? 0 : std::min<int>(ktrkhits[itrk*3 + plane], nwires);
+    }
+    float hitDedx(int itrk, int ihit) const {
+        if (skim) return skim_dedx[skim_offset[itrk] + ihit];
+        return trk_dedx_reco[((size_t)itrk*3 + hitPlane(itrk))*nwires + ihit];
+    }
+    const float *hitXYZ(int itrk, int ihit) const {
+        if (skim) return &skim_xyz[(size_t)(skim_offset[itrk] + ihit)*3];
+        return &trk_xyz[(((size_t)itrk*3 + hitPlane(itrk))*nwires + ihit)*3];
+    }
+
+    // Update derived indices after GetEntry
+    void prepare() {
+        if (!skim) return;
+        Int_t offset = 0;
+        for (int itrk = 0; itrk < ktrk; itrk++) {
+            skim_offset[itrk] = offset;
+            offset += skim_nhits[itrk];
+        }
+    }
+
+    // Enable only the branches used by the feature calculation and point them at the buffers
+    // Returns false if readVertex is set but the tree has no truth neutrino vertex
+    bool attach(TTree *intree) {
+        skim = isSkimTree(intree);
+
+        intree->SetBranchStatus("*", 0);
+        const char *used[] = {"nPFParticles", "ntracks_pandoraTrack", "pfp_isTrack", "trkpidbestplane_pandoraTrack",
+                              "ntrkhits_pandoraTrack", "trkpidpida_pandoraTrack", "trkmomrange_pandoraTrack",
+                              "trkstartdcosx_pandoraTrack", "trkstartdcosy_pandoraTrack", "trkstartdcosz_pandoraTrack",
+                              "nshowers_pandoraShower", "pfp_isShower",
+                              "shwr_bestplane_pandoraShower", "shwr_totEng_pandoraShower", "shwr_startdcosx_pandoraShower",
+                              "shwr_startdcosy_pandoraShower", "shwr_startdcosz_pandoraShower"};
+        for (const char *name : used) intree->SetBranchStatus(name, 1);
+
+        intree->SetBranchAddress("nPFParticles", &kPFP);
+
+        intree->SetBranchAddress("ntracks_pandoraTrack", &ktrk);
+        intree->SetBranchAddress("pfp_isTrack", is_trk.data());
+        intree->SetBranchAddress("trkpidbestplane_pandoraTrack", trk_bestplane.data());
+        intree->SetBranchAddress("ntrkhits_pandoraTrack", ktrkhits.data());
+        intree->SetBranchAddress("trkpidpida_pandoraTrack", trk_pida.data());
+        intree->SetBranchAddress("trkmomrange_pandoraTrack", trk_momrange_reco.data());
+        intree->SetBranchAddress("trkstartdcosx_pandoraTrack", trk_start_xhat.data());
+        intree->SetBranchAddress("trkstartdcosy_pandoraTrack", trk_start_yhat.data());
+        intree->SetBranchAddress("trkstartdcosz_pandoraTrack", trk_start_zhat.data());
+
+        if (skim) {
+            const char *hits[] = {"trkhitplane_skim", "ntrkhits_skim", "nskimhits", "trkdedx_skim", "trkxyz_skim"};
+            for (const char *name : hits) intree->SetBranchStatus(name, 1);
+            intree->SetBranchAddress("trkhitplane_skim", skim_hitplane.data());
+            intree->SetBranchAddress("ntrkhits_skim", skim_nhits.data());
+            intree->SetBranchAddress("nskimhits", &nskimhits);
+            intree->SetBranchAddress("trkdedx_skim", skim_dedx.data());
+            intree->SetBranchAddress("trkxyz_skim", skim_xyz.data());
+        } else {
+            intree->SetBranchStatus("trkdedx_pandoraTrack", 1);
+            intree->SetBranchStatus("trkxyz_pandoraTrack", 1);
+            intree->SetBranchAddress("trkdedx_pandoraTrack", trk_dedx_reco.data());
+            intree->SetBranchAddress("trkxyz_pandoraTrack", trk_xyz.data());
+        }
+
+        intree->SetBranchAddress("nshowers_pandoraShower", &kshwr);
+        intree->SetBranchAddress("pfp_isShower", is_shwr.data());
+        intree->SetBranchAddress("shwr_bestplane_pandoraShower", shwr_bestplane.data());
+        intree->SetBranchAddress("shwr_totEng_pandoraShower", shwr_totEng_reco.data());
+        intree->SetBranchAddress("shwr_startdcosx_pandoraShower", shwr_start_xhat.data());
+        intree->SetBranchAddress("shwr_startdcosy_pandoraShower", shwr_start_yhat.data());
+        intree->SetBranchAddress("shwr_startdcosz_pandoraShower", shwr_start_zhat.data());
+
+        nnuvtx = 0;
+        if (readVertex) {
+            if (!intree->GetBranch("nuvtxx_truth")) {
+                std::cerr << "EventBuffers: no branch nuvtxx_truth in " << intree->GetName() << ", cannot read the neutrino vertex" << std::endl;
+                return false;
+            }
+            const char *vtx[] = {"nnuvtx", "nuvtxx_truth", "nuvtxy_truth", "nuvtxz_truth"};
+            for (const char *name : vtx) intree->SetBranchStatus(name, 1);
+            intree->SetBranchAddress("nnuvtx", &nnuvtx);
+            intree->SetBranchAddress("nuvtxx_truth", nuvtxx.data());
+            intree->SetBranchAddress("nuvtxy_truth", nuvtxy.data());
+            intree->SetBranchAddress("nuvtxz_truth", nuvtxz.data());
+        }
+        return true;
+    }
+};
+
+// Calculate the feature vars of the event currently held in b
+// Quality cuts and plane choice are applied once per particle, the accepted particles go to b.particles
+inline void calcEventFeatures(EventBuffers &b, FeatureVars &fv) {
+    const Float_t m_p = 938.2720894;  // MeV
+    const Float_t m_mu = 105.6583755; // MeV
+
+    const Short_t ktrk = b.ktrk;
+    const Short_t kshwr = b.kshwr;
+    ParticleList &particles = b.particles;
+    particles.clear();
+
+    fv.num_showers = 0;
+    fv.num_tracks = 0;
+    fv.num_p = 0;
+    fv.num_mu = 0;
+    fv.trk_vis_eng = 0;
+    fv.shwr_vis_eng = 0;
+
+    // Loop over all particles in event
+    for (int ipart = 0; ipart < std::max(ktrk, kshwr); ipart+=1) {
+        Short_t plane;
+
+        if((b.is_trk[ipart] > 0.5) && (b.is_trk[ipart] < 1.5) && (ipart < ktrk)){
+            // Cut poorly constructed tracks
+            const Float_t xhat = b.trk_start_xhat[ipart], yhat = b.trk_start_yhat[ipart], zhat = b.trk_start_zhat[ipart];
+            if (b.trk_momrange_reco[ipart] < 0) continue;
+            if ((xhat*xhat + yhat*yhat + zhat*zhat) > 1.1) continue;
+            plane = b.pidPlane(ipart);
+            if (plane < 0) continue;  // no valid plane for the PID
+
+            // Multiplicity
+            fv.num_tracks += 1;
+            Float_t mass;
+            if (b.pida(ipart, plane) > 10) {
+                fv.num_p++;
+                mass = m_p;
+            } else {
+                fv.num_mu++;
+                mass = m_mu;
+            }
+
+            // Kinematics
+            plane = b.hitPlane(ipart);
+            const int nhits = b.hitCount(ipart);
+            for(int iwire = 1; iwire<nhits; iwire++){
+                if(b.hitDedx(ipart, iwire) > 100) continue;
+
+                const float *xyz = b.hitXYZ(ipart, iwire);
+                const float *xyz_prev = b.hitXYZ(ipart, iwire-1);
+                const double dx = xyz[0] - xyz_prev[0];
+                const double dy = xyz[1] - xyz_prev[1];
+                const double dz = xyz[2] - xyz_prev[2];
+                const Float_t dr = std::sqrt(dx*dx + dy*dy + dz*dz);
+
+                fv.trk_vis_eng += b.hitDedx(ipart, iwire) * dr;
+            }
+
+            particles.add(b.trk_momrange_reco[ipart] * 1e3, xhat, yhat, zhat, mass, plane); // MeV
+
+        } else if((b.is_shwr[ipart] > 0.5) && (b.is_shwr[ipart] < 1.5) && (ipart < kshwr)) {
+            // Cut poorly constructed showers
+            const Float_t xhat = b.shwr_start_xhat[ipart], yhat = b.shwr_start_yhat[ipart], zhat = b.shwr_start_zhat[ipart];
+            plane = b.shwrPlane(ipart);
+            if (plane < 0) continue;  // no valid plane for the energy
+            if (b.shwrEng(ipart, plane) < 0) continue;
+            if ((xhat*xhat + yhat*yhat + zhat*zhat) > 1.1) continue;
+
+            // Multiplicity
+            fv.num_showers += 1;
+
+            // Kinematics
+            fv.shwr_vis_eng += b.shwrEng(ipart, plane);
+
+            particles.add(b.shwrEng(ipart, plane), xhat, yhat, zhat, 0, plane); // MeV
+
+        } else {
+            particles.addSkipped();
+        }
+    }
+
+    // Add calculated variables to tree
+    fv.num_particles = fv.num_tracks + fv.num_showers;
+
+    fv.tot_vis_eng = fv.shwr_vis_eng + fv.trk_vis_eng;
+
+    EventShape shape;
+    calcEventShape(particles, shape);
+    fv.tot_momentum = shape.tot_momentum;
+    fv.inv_mass = shape.inv_mass;
+    fv.sphericity = shape.sphericity;
+    fv.aplanarity = shape.aplanarity;
+
+    const double vis_eng_sqrd = (double)fv.tot_vis_eng * fv.tot_vis_eng;
+    fv.FW0 = shape.FW0 / vis_eng_sqrd;
+    fv.FW1 = shape.FW1 / vis_eng_sqrd;
+    fv.FW2 = shape.FW2 / vis_eng_sqrd;
+}
+
+// Run compute over every entry of the planned ranges on nthreads workers
+// compute(EventBuffers&, Row&) is called on the worker threads
+// sink(const Row&) is called on the calling thread, once per entry and in input order
+// With readVertex the truth neutrino vertices are read into the buffers as well, returns -1 if an input has none
+template <typename Row, typename Compute, typename Sink>
+Long64_t runEventLoop(const std::vector<InputFileInfo> &infos, const std::vector<EntryRange> &ranges,
+                      const std::string &treeName, int nthreads, Compute compute, Sink sink,
+                      bool readVertex = false) {
+    if (ranges.empty()) return 0;
+    if (nthreads <= 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+    nthreads = std::min<int>(nthreads, ranges.size());
+    ROOT::EnableThreadSafety();
+
+    std::vector<std::vector<Row>> chunks(ranges.size());
+    std::vector<char> done(ranges.size(), 0);
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+    std::atomic<size_t> next_range(0);
+    std::atomic<bool> failed(false);
+
+    auto worker = [&]() {
+        EventBuffers buffers(infos);
+        buffers.readVertex = readVertex;
+        TFile *infile = nullptr;
+        TTree *intree = nullptr;
+        int open_file = -1;
+
+        for (size_t r = next_range++; r < ranges.size(); r = next_range++) {
+            const EntryRange &range = ranges[r];
+            if (!failed && range.file != open_file) {
+                delete infile;
+                infile = TFile::Open(infos[range.file].name.c_str());
+                intree = (infile && !infile->IsZombie()) ? (TTree*)infile->Get(treeName.c_str()) : nullptr;
+                if (!intree) {
+                    std::cerr << "runEventLoop: cannot read tree " << treeName << " from " << infos[range.file].name << std::endl;
+                    failed = true;
+                } else if (!buffers.attach(intree)) {
+                    failed = true;
+                }
+                open_file = range.file;
+            }
+
+            // After a failure the remaining ranges are only marked done so the calling thread does not wait on them
+            if (!failed) {
+                intree->SetCacheEntryRange(range.first, range.last);
+                std::vector<Row> &rows = chunks[r];
+                rows.resize(range.last - range.first);
+                for (Long64_t en = range.first; en < range.last; en++) {
+                    intree->GetEntry(en);
+                    buffers.prepare();
+                    compute(buffers, rows[en - range.first]);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(done_mutex);
+            done[r] = 1;
+            done_cv.notify_all();
+        }
+        delete infile;
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < nthreads; t++) workers.emplace_back(worker);
+
+    // Hand the chunks to the sink in input order as soon as they are ready
+    Long64_t nprocessed = 0;
+    for (size_t r = 0; r < ranges.size(); r++) {
+        {
+            std::unique_lock<std::mutex> lock(done_mutex);
+            done_cv.wait(lock, [&]() { return done[r] != 0; });
+        }
+        if (!failed) {
+            for (const Row &row : chunks[r]) sink(row);
+            nprocessed += chunks[r].size();
+        }
+        std::vector<Row>().swap(chunks[r]);
+    }
+
+    for (std::thread &t : workers) t.join();
+    return failed ? -1 : nprocessed;
+}
+
+#endif
@@ -0,0 +1,149 @@
+// featureKernel.h computes the per event kinematic and event shape variables from a compact particle list
+// The particle list is built once per event as a structure of arrays and reused between events without reallocating
+// Fox-Wolfram moments are computed from the first and second momentum moments of the list instead of a loop over all pairs
+//   sum_ij p_i p_j                 = (sum_i p_i)^2
+//   sum_ij p_i p_j cos(theta_ij)    = |sum_i p_i u_i|^2
+//   sum_ij p_i p_j cos^2(theta_ij)  = sum_ab T_ab T_ab  with  T_ab = sum_i p_i u_ia u_ib
+// The sphericity tensor eigenvalues come from the closed form solution for symmetric 3x3 matrices
+
+#ifndef FEATUREKERNEL_H
+#define FEATUREKERNEL_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// Structure of arrays holding the accepted tracks and showers of one event
+struct ParticleList {
+    int n = 0;
+    std::vector<float> p;      // momentum magnitude [MeV/c]
+    std::vector<float> ux;     // direction cosines as reconstructed (not renormalised)
+    std::vector<float> uy;
+    std::vector<float> uz;
+    std::vector<float> mass;   // mass hypothesis [MeV/c^2], 0 for showers
+    std::vector<short> plane;  // plane the particle was measured on
+    std::vector<float> fw_mult; // weight of the particle on the j side of the Fox-Wolfram sum, see addSkipped()
+
+    ParticleList(int capacity = 0) { reserve(capacity); }
+
+    void reserve(int capacity) {
+        p.resize(capacity); ux.resize(capacity); uy.resize(capacity); uz.resize(capacity);
+        mass.resize(capacity); plane.resize(capacity); fw_mult.resize(capacity);
+    }
+
+    void clear() { n = 0; }
+
+    void add(float p_i, float ux_i, float uy_i, float uz_i, float mass_i, short plane_i) {
+        if (n == (int)p.size()) reserve(std::max(8, 2*n));
+        p[n] = p_i; ux[n] = ux_i; uy[n] = uy_i; uz[n] = uz_i;
+        mass[n] = mass_i; plane[n] = plane_i; fw_mult[n] = 1;
+        n++;
+    }
+
+    // An index that is neither a track nor a shower was counted again on the j side of the
+    // original pairwise Fox-Wolfram loop with the last accepted particle, keep that weighting
+    void addSkipped() {
+        if (n > 0) fw_mult[n-1] += 1;
+    }
+};
+
+// Kinematic and event shape variables of one event
+// FW moments are not normalised, divide by the squared visible energy
+struct EventShape {
+    float tot_momentum;
+    float inv_mass;
+    float sphericity;
+    float aplanarity;
+    float FW0;
+    float FW1;
+    float FW2;
+};
+
+// Eigenvalues of the symmetric matrix {{a00,a01,a02},{a01,a11,a12},{a02,a12,a22}} in descending order
+inline void symEigenvalues3(double a00, double a01, double a02, double a11, double a12, double a22, double eig[3]) {
+    const double p1 = a01*a01 + a02*a02 + a12*a12;
+    const double q = (a00 + a11 + a22) / 3;
+    const double p2 = (a00-q)*(a00-q) + (a11-q)*(a11-q) + (a22-q)*(a22-q) + 2*p1;
+
+    if (p2 <= 0 || p1 <= 1e-30 * p2) {
+        // Already diagonal
+        eig[0] = a00; eig[1] = a11; eig[2] = a22;
+    } else {
+        const double p = std::sqrt(p2 / 6);
+        const double b00 = (a00-q)/p, b11 = (a11-q)/p, b22 = (a22-q)/p;
+        const double b01 = a01/p, b02 = a02/p, b12 = a12/p;
+        double r = 0.5 * (b00*(b11*b22 - b12*b12) - b01*(b01*b22 - b12*b02) + b02*(b01*b12 - b11*b02));
+        r = std::min(1.0, std::max(-1.0, r));
+        const double phi = std::acos(r) / 3;
+        eig[0] = q + 2*p*std::cos(phi);
+        eig[2] = q + 2*p*std::cos(phi + 2*M_PI/3);
+        eig[1] = 3*q - eig[0] - eig[2];
+    }
+    std::sort(eig, eig + 3, [](double x, double y) { return x > y; });
+}
+
+// Compute the kinematic and event shape variables of the particles in list
+inline void calcEventShape(const ParticleList &list, EventShape &shape) {
+    double tot_p[3] = {0, 0, 0};
+    double tot_Eng = 0;
+    double sum_p_sqrd = 0;
+    double S00 = 0, S01 = 0, S02 = 0, S11 = 0, S12 = 0, S22 = 0;  // sphericity tensor
+    double A = 0, B = 0;                                             // sum p, sum w p
+    double V[3] = {0, 0, 0}, W[3] = {0, 0, 0};                       // sum p u, sum w p u
+    double T00 = 0, T01 = 0, T02 = 0, T11 = 0, T12 = 0, T22 = 0;     // sum p u u
+    double U00 = 0, U01 = 0, U02 = 0, U11 = 0, U12 = 0, U22 = 0;     // sum w p u u
+
+    const float *p = list.p.data();
+    const float *ux = list.ux.data();
+    const float *uy = list.uy.data();
+    const float *uz = list.uz.data();
+    const float *mass = list.mass.data();
+    const float *w = list.fw_mult.data();
+
+    for (int i = 0; i < list.n; i++) {
+        const double pi = p[i];
+        const double px = pi*ux[i], py = pi*uy[i], pz = pi*uz[i];
+        const double wi = w[i];
+
+        tot_p[0] += px; tot_p[1] += py; tot_p[2] += pz;
+        tot_Eng += std::sqrt((double)mass[i]*mass[i] + pi*pi);
+
+        sum_p_sqrd += pi*pi;
+        S00 += px*px; S01 += px*py; S02 += px*pz;
+        S11 += py*py; S12 += py*pz; S22 += pz*pz;
+
+        A += pi;
+        B += wi*pi;
+        V[0] += px; V[1] += py; V[2] += pz;
+        W[0] += wi*px; W[1] += wi*py; W[2] += wi*pz;
+
+        const double tx = px*ux[i], ty = py*uy[i], tz = pz*uz[i];
+        T00 += tx;        T01 += px*uy[i]; T02 += px*uz[i];
+        T11 += ty;        T12 += py*uz[i]; T22 += tz;
+        U00 += wi*tx;     U01 += wi*px*uy[i]; U02 += wi*px*uz[i];
+        U11 += wi*ty;     U12 += wi*py*uz[i]; U22 += wi*tz;
+    }
+
+    const double tot_momentum = std::sqrt(tot_p[0]*tot_p[0] + tot_p[1]*tot_p[1] + tot_p[2]*tot_p[2]);
+    shape.tot_momentum = tot_momentum;
+    shape.inv_mass = std::sqrt(tot_Eng*tot_Eng - tot_momentum*tot_momentum);
+
+    // Events without particles have no defined event shape
+    if (sum_p_sqrd > 0) {
+        double eig[3];
+        symEigenvalues3(S00/sum_p_sqrd, S01/sum_p_sqrd, S02/sum_p_sqrd, S11/sum_p_sqrd, S12/sum_p_sqrd, S22/sum_p_sqrd, eig);
+        // The original definition evaluated 3/2 in integer arithmetic, keep it so feature files stay comparable
+        shape.sphericity = eig[1] + eig[2];
+        shape.aplanarity = eig[2];
+    } else {
+        shape.sphericity = 0;
+        shape.aplanarity = 0;
+    }
+
+    const double cos2 = T00*U00 + T11*U11 + T22*U22 + 2*(T01*U01 + T02*U02 + T12*U12);
+    shape.FW0 = A*B;
+    shape.FW1 = V[0]*W[0] + V[1]*W[1] + V[2]*W[2];
+    shape.FW2 = 1.5*cos2 - 0.5*A*B;
+}
+
+#endif
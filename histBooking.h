@@ -0,0 +1,71 @@
+// histBooking.h books a table of 1D histograms on an RDataFrame so all of them are filled in one pass over the data
+// Each variable has a binning and an optional weight column, the same information as the nbin/low/up arrays of the draw macros
+// With ROOT::EnableImplicitMT the pass is multi-threaded, every thread fills its own copies which are merged at the end
+// Several data frames (e.g. signal and background) can be run concurrently with runAndCollect()
+
+#ifndef HISTBOOKING_H
+#define HISTBOOKING_H
+
+#include <string>
+#include <vector>
+#include <TH1D.h>
+#include <TString.h>
+#include <ROOT/RDataFrame.hxx>
+#include <ROOT/RDFHelpers.hxx>
+
+// One histogram of the table
+struct HistSpec {
+    std::string var;      // column to histogram
+    int nbin;
+    double low;
+    double up;
+    std::string weight;   // weight column, empty for unweighted
+};
+
+// Build the spec table from the per variable arrays used by the draw macros
+inline std::vector<HistSpec> makeHistSpecs(int nh, const TString *var, const int *nbin, const float *low, const float *up,
+                                           const std::string &weight = "") {
+    std::vector<HistSpec> specs;
+    for (int i = 0; i < nh; i++) {
+        specs.push_back({var[i].Data(), nbin[i], low[i], up[i], weight});
+    }
+    return specs;
+}
+
+// Book one histogram per spec, named <var>_<suffix> (or <var> for an empty suffix)
+// Nothing is read until the results are accessed
+inline std::vector<ROOT::RDF::RResultPtr<TH1D>> bookHistograms(ROOT::RDF::RNode df, const std::vector<HistSpec> &specs, const std::string &suffix) {
+    std::vector<ROOT::RDF::RResultPtr<TH1D>> booked;
+    for (const HistSpec &spec : specs) {
+        std::string name = suffix.empty() ? spec.var : spec.var + "_" + suffix;
+        ROOT::RDF::TH1DModel model(name.c_str(), name.c_str(), spec.nbin, spec.low, spec.up);
+        if (spec.weight.empty()) {
+            booked.push_back(df.Histo1D(model, spec.var));
+        } else {
+            booked.push_back(df.Histo1D(model, spec.var, spec.weight));
+        }
+    }
+    return booked;
+}
+
+// Run the event loops of all booked histograms together and return detached copies, in booking order
+inline std::vector<std::vector<TH1D*>> runAndCollect(std::vector<std::vector<ROOT::RDF::RResultPtr<TH1D>>> &booked) {
+    std::vector<ROOT::RDF::RResultHandle> handles;
+    for (auto &set : booked) {
+        for (auto &h : set) handles.emplace_back(h);
+    }
+    ROOT::RDF::RunGraphs(handles);
+
+    std::vector<std::vector<TH1D*>> hists;
+    for (auto &set : booked) {
+        hists.emplace_back();
+        for (auto &h : set) {
+            TH1D *copy = (TH1D*)h->Clone();
+            copy->SetDirectory(nullptr);
+            hists.back().push_back(copy);
+        }
+    }
+    return hists;
+}
+
+#endif
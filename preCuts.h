@@ -0,0 +1,156 @@
+// preCuts.h holds the pre-cut thresholds shared by cutFeatures.C and runPipeline.C and the cut-flow bookkeeping
+// Cuts are applied in order, an event is counted against the first cut it fails
+// cutSample() is the per-sample body of cutFeatures.C, also called by benchmark.C
+
+#ifndef PRECUTS_H
+#define PRECUTS_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <TFile.h>
+#include <TTree.h>
+#include <TH1D.h>
+#include <TString.h>
+#include "featureEngine.h"
+
+// Pre-cut thresholds, events are kept if
+//   num_particles  >= min_num_particles
+//   tot_momentum   <  max_tot_momentum
+//   visible_energy <= max_tot_vis_eng
+struct PreCuts {
+    Short_t min_num_particles = 2;
+    Float_t max_tot_momentum = 980;   // MeV/c
+    Float_t max_tot_vis_eng = 1800;   // MeV
+};
+
+const int kNumPreCuts = 3;
+
+// Index of the first cut the event fails, kNumPreCuts if it passes all of them
+inline int firstFailedCut(const PreCuts &cuts, const FeatureVars &fv) {
+    if (fv.num_particles < cuts.min_num_particles) return 0;
+    if (fv.tot_momentum >= cuts.max_tot_momentum) return 1;
+    if (fv.tot_vis_eng > cuts.max_tot_vis_eng) return 2;
+    return kNumPreCuts;
+}
+
+// Number of events and sum of weights remaining after each cut
+struct CutFlow {
+    PreCuts cuts;
+    Long64_t nevents[kNumPreCuts + 1] = {0};  // [0] all events, [i] after cut i-1
+    Double_t sumw[kNumPreCuts + 1] = {0};
+
+    CutFlow(const PreCuts &precuts) : cuts(precuts) {}
+
+    // Count an event, returns true if it passes all cuts
+    bool add(const FeatureVars &fv, Double_t weight) {
+        int failed = firstFailedCut(cuts, fv);
+        for (int i = 0; i <= failed; i++) {
+            nevents[i]++;
+            sumw[i] += weight;
+        }
+        return failed == kNumPreCuts;
+    }
+
+    TString label(int i) const {
+        if (i == 0) return "all events";
+        if (i == 1) return Form("num_particles >= %d", cuts.min_num_particles);
+        if (i == 2) return Form("tot_momentum < %g", cuts.max_tot_momentum);
+        return Form("visible_energy <= %g", cuts.max_tot_vis_eng);
+    }
+
+    void print(const std::string &id) const {
+        std::cout << id << " cut flow" << std::endl;
+        for (int i = 0; i <= kNumPreCuts; i++) {
+            std::cout << Form("  %-24s %10lld events (%6.2f%%)  sum of weights %g", label(i).Data(), nevents[i],
+                              nevents[0] ? 100.0 * nevents[i] / nevents[0] : 0.0, sumw[i]) << std::endl;
+        }
+    }
+
+    // Histogram of events remaining after each cut, with labelled bins
+    TH1D *toHist(const char *name) const {
+        TH1D *h = new TH1D(name, "events after each pre-cut", kNumPreCuts + 1, -0.5, kNumPreCuts + 0.5);
+        for (int i = 0; i <= kNumPreCuts; i++) {
+            h->SetBinContent(i + 1, nevents[i]);
+            h->GetXaxis()->SetBinLabel(i + 1, label(i));
+        }
+        return h;
+    }
+};
+
+// Apply the pre-cuts to the feature var file varFileName (tree "feats") and weight file wFileName (tree "weight") of one sample
+// The kept events go to cutVarFileName, with the histogram "cutflow", and their weights to cutWFileName
+// With normalize the weights of the kept events are scaled to the number of events before the cuts, as for the atm sample
+// Returns false if the inputs cannot be read, cutflow counts the events of the sample and starts out empty
+inline bool cutSample(const std::string &varFileName, const std::string &wFileName, const std::string &cutVarFileName,
+                      const std::string &cutWFileName, const std::string &id, bool normalize, CutFlow &cutflow) {
+    // Read uncut feature var and weight files
+    TFile *varfile = TFile::Open(varFileName.c_str());
+    TFile *wfile = TFile::Open(wFileName.c_str());
+    TTree *vartree = (varfile && !varfile->IsZombie()) ? (TTree*)varfile->Get("feats") : nullptr;
+    TTree *wtree = (wfile && !wfile->IsZombie()) ? (TTree*)wfile->Get("weight") : nullptr;
+    if (!vartree || !wtree || vartree->GetEntries() != wtree->GetEntries()) {
+        std::cerr << "cutSample: cannot read matching feats and weight trees from " << varFileName << " and " << wFileName << std::endl;
+        delete varfile;
+        delete wfile;
+        return false;
+    }
+
+    // Create new files with trees for feature vars and weights
+    TFile *cut_varfile = TFile::Open(cutVarFileName.c_str(), "RECREATE");
+    TTree *cut_vartree = new TTree("feats", Form("%s feature vars with pre-cuts applied", id.c_str()));
+
+    TFile *cut_wfile = TFile::Open(cutWFileName.c_str(), "RECREATE");
+    TTree *cut_wtree = new TTree("weight", Form("%s normalized weights with pre-cuts applied", id.c_str()));
+
+    // Define feature vars for uncut file, the cut file shares the same buffer
+    FeatureVars fv;
+    setFeatureVarsAddress(vartree, fv);
+    branchFeatureVars(cut_vartree, fv);
+
+    // Define weight for uncut file
+    Double_t weight;
+    wtree->SetBranchAddress("Weight", &weight);
+
+    // Create pre-cut weight file branches
+    Double_t cut_weight;
+    cut_wtree->Branch("Weight", &cut_weight);
+
+    // Weights of the kept events, filled after normalization
+    std::vector<Double_t> kept_weights;
+
+    // Loop over all events
+    Long64_t nentries = vartree->GetEntries();
+    for (Long64_t en = 0; en < nentries; en++) {
+        vartree->GetEntry(en);
+        wtree->GetEntry(en);
+
+        if (!cutflow.add(fv, weight)) continue;
+
+        cut_vartree->Fill();
+        kept_weights.push_back(weight);
+    }
+
+    // Normalize weights
+    Long64_t ncut_entries = kept_weights.size();
+    if (normalize && ncut_entries > 0) {
+        for (Double_t &w : kept_weights) w *= ((double)nentries / (double)ncut_entries);
+    }
+    for (Double_t w : kept_weights) {
+        cut_weight = w;
+        cut_wtree->Fill();
+    }
+
+    // Write the new trees to the files
+    cut_varfile->cd();
+    cutflow.toHist("cutflow");
+    cut_varfile->Write();
+    cut_wfile->Write();
+    delete cut_varfile;
+    delete cut_wfile;
+    delete varfile;
+    delete wfile;
+    return true;
+}
+
+#endif
@@ -0,0 +1,243 @@
+// sensitivity.h computes the n-nbar sensitivity of classification.ipynb from the BDT scores of signal and background events
+// Weighted signal and background efficiencies of the cut score >= threshold are found for every threshold with one sort and running sums
+// The working point at a target background efficiency is interpolated linearly between neighbouring thresholds
+// The Bayesian upper limit on the number of signal events is solved continuously in n_s, all Poisson sums are done in log space
+// Bootstrap toys reweight every event by a Poisson(1) count and run on nthreads threads, each toy has its own seed so results do not depend on nthreads
+// From ROOT macros include this file, from Python use ROOT.gInterpreter.Declare('#include "sensitivity.h"') and pass numpy float64 arrays
+
+#ifndef SENSITIVITY_H
+#define SENSITIVITY_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <Rtypes.h>
+
+// Exposure and conversion constants, the defaults are the values used in classification.ipynb
+struct SensitivityParams {
+    double n_neutrons = 1.33153e34;        // neutrons in the fiducial volume
+    double years = 10;                     // exposure [yr]
+    double eff_precut = 0.942;             // signal efficiency of the pre-cuts
+    double R = 5.6e22 / 5.154e7;           // nuclear suppression factor [yr^-1], bound lifetime [yr] to free lifetime [s]
+    double n_bkg_precut = 2886 * 40;       // background events passing the pre-cuts for the exposure, DUNE TDR
+    double target_bkg_eff = 2e-4;          // background efficiency of the working point, 99.98% rejection
+    double cl = 0.9;                       // confidence level of the limit
+};
+
+// Events of both samples sorted by descending score
+struct ScoredEvents {
+    std::vector<double> score;
+    std::vector<double> weight;
+    std::vector<char> signal;
+};
+
+inline ScoredEvents sortScores(const double *sig_score, const double *sig_weight, Long64_t nsig,
+                               const double *bkg_score, const double *bkg_weight, Long64_t nbkg) {
+    std::vector<Long64_t> order(nsig + nbkg);
+    std::iota(order.begin(), order.end(), 0);
+    auto score = [&](Long64_t i) { return (i < nsig) ? sig_score[i] : bkg_score[i - nsig]; };
+    std::sort(order.begin(), order.end(), [&](Long64_t a, Long64_t b) { return score(a) > score(b); });
+
+    ScoredEvents events;
+    events.score.reserve(order.size());
+    events.weight.reserve(order.size());
+    events.signal.reserve(order.size());
+    for (Long64_t i : order) {
+        events.score.push_back(score(i));
+        events.weight.push_back((i < nsig) ? sig_weight[i] : bkg_weight[i - nsig]);
+        events.signal.push_back(i < nsig);
+    }
+    return events;
+}
+
+// Efficiencies of score >= threshold[i], thresholds are the distinct scores in descending order
+struct EfficiencyCurve {
+    std::vector<double> threshold;
+    std::vector<double> sig_eff;
+    std::vector<double> bkg_eff;
+};
+
+// Running sums over the sorted events, count[i] multiplies the weight of event i if given (bootstrap toys)
+inline EfficiencyCurve efficiencyCurve(const ScoredEvents &events, const std::vector<int> *count = nullptr) {
+    const size_t n = events.score.size();
+    double sig_total = 0, bkg_total = 0;
+    for (size_t i = 0; i < n; i++) {
+        double w = count ? events.weight[i] * (*count)[i] : events.weight[i];
+        (events.signal[i] ? sig_total : bkg_total) += w;
+    }
+
+    EfficiencyCurve curve;
+    double sig_sum = 0, bkg_sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        double w = count ? events.weight[i] * (*count)[i] : events.weight[i];
+        (events.signal[i] ? sig_sum : bkg_sum) += w;
+        // One point per distinct score, after all events with that score
+        if (i + 1 == n || events.score[i + 1] != events.score[i]) {
+            curve.threshold.push_back(events.score[i]);
+            curve.sig_eff.push_back(sig_total > 0 ? sig_sum / sig_total : 0);
+            curve.bkg_eff.push_back(bkg_total > 0 ? bkg_sum / bkg_total : 0);
+        }
+    }
+    return curve;
+}
+
+inline EfficiencyCurve efficiencyCurve(const double *sig_score, const double *sig_weight, Long64_t nsig,
+                                       const double *bkg_score, const double *bkg_weight, Long64_t nbkg) {
+    return efficiencyCurve(sortScores(sig_score, sig_weight, nsig, bkg_score, bkg_weight, nbkg));
+}
+
+struct WorkingPoint {
+    double threshold;
+    double sig_eff;
+    double bkg_eff;
+};
+
+// Working point with background efficiency target_bkg_eff, interpolated linearly in the background efficiency
+// Above the first threshold the efficiencies go to 0, below the last one the last point is returned
+// Interpolation starts from the last point with bkg_eff <= target_bkg_eff, so of several points on the target the one with the highest signal efficiency is taken
+inline WorkingPoint workingPoint(const EfficiencyCurve &curve, double target_bkg_eff) {
+    const size_t n = curve.threshold.size();
+    if (n == 0) return {0, 0, 0};
+    size_t k = std::upper_bound(curve.bkg_eff.begin(), curve.bkg_eff.end(), target_bkg_eff) - curve.bkg_eff.begin();
+    if (k == n) return {curve.threshold[n-1], curve.sig_eff[n-1], curve.bkg_eff[n-1]};
+
+    double t0 = (k == 0) ? curve.threshold[0] : curve.threshold[k-1];
+    double s0 = (k == 0) ? 0 : curve.sig_eff[k-1];
+    double b0 = (k == 0) ? 0 : curve.bkg_eff[k-1];
+    double f = (curve.bkg_eff[k] > b0) ? (target_bkg_eff - b0) / (curve.bkg_eff[k] - b0) : 1;
+    return {t0 + f * (curve.threshold[k] - t0), s0 + f * (curve.sig_eff[k] - s0), target_bkg_eff};
+}
+
+// log(exp(a) + exp(b))
+inline double logAddExp(double a, double b) {
+    if (a == -INFINITY) return b;
+    if (b == -INFINITY) return a;
+    return std::max(a, b) + std::log1p(std::exp(-std::abs(a - b)));
+}
+
+// log of the Poisson probability of k events for mean mu
+inline double logPoisson(int k, double mu) {
+    if (mu <= 0) return (k == 0) ? 0 : -INFINITY;
+    return k * std::log(mu) - mu - std::lgamma(k + 1.0);
+}
+
+// log sum_n P(n|n_b) P(N <= n | n_b + n_s), the probability mass of signal above n_s up to a constant
+// Only n in [nmin, nmax] is summed, outside P(n|n_b) and the part of P(N <= n) below nmin are negligible
+inline double logSignalTail(double n_s, double n_b, int nmin, int nmax) {
+    double logsum = -INFINITY;
+    double logcdf = -INFINITY;
+    for (int n = nmin; n <= nmax; n++) {
+        logcdf = logAddExp(logcdf, logPoisson(n, n_b + n_s));
+        logsum = logAddExp(logsum, logPoisson(n, n_b) + logcdf);
+    }
+    return logsum;
+}
+
+// Bayesian upper limit on n_s with a flat prior, averaged over background-only outcomes as in classification.ipynb
+// The posterior is p(n_s) ~ sum_n P(n|n_s+n_b) P(n|n_b), its integral above n_s is sum_n P(n|n_b) P(N <= n | n_s+n_b)
+// The limit is the n_s where this is 1 - cl of the total, found by bisection
+inline double poissonUpperLimit(double n_b, double cl = 0.9) {
+    const int nmin = (int)std::max(0.0, std::floor(n_b - 12 * std::sqrt(n_b) - 30));
+    const int nmax = (int)std::ceil(n_b + 12 * std::sqrt(n_b) + 30);
+    const double target = std::log(1 - cl) + logSignalTail(0, n_b, nmin, nmax);
+
+    double lo = 0, hi = std::max(10.0, 2 * std::sqrt(n_b));
+    while (logSignalTail(hi, n_b, nmin, nmax) > target) hi *= 2;
+    for (int it = 0; it < 100 && hi - lo > 1e-9 * hi; it++) {
+        double mid = 0.5 * (lo + hi);
+        (logSignalTail(mid, n_b, nmin, nmax) > target ? lo : hi) = mid;
+    }
+    return 0.5 * (lo + hi);
+}
+
+struct LifetimeLimit {
+    double sig_eff;
+    double n_b;              // expected background events at the working point
+    double n_s;              // upper limit on the number of signal events
+    double bound_lifetime;   // [yr]
+    double free_lifetime;    // [s]
+};
+
+inline LifetimeLimit lifetimeLimit(double sig_eff, double bkg_eff, const SensitivityParams &params) {
+    LifetimeLimit limit;
+    limit.sig_eff = sig_eff;
+    limit.n_b = params.n_bkg_precut * bkg_eff;
+    limit.n_s = poissonUpperLimit(limit.n_b, params.cl);
+    double rate = limit.n_s / (params.n_neutrons * params.years * params.eff_precut * sig_eff);
+    limit.bound_lifetime = 1 / rate;
+    limit.free_lifetime = std::sqrt(limit.bound_lifetime / params.R);
+    return limit;
+}
+
+// Nominal limit and the free lifetime limits of the bootstrap toys, sorted
+struct LimitBand {
+    WorkingPoint wp;
+    LifetimeLimit nominal;
+    std::vector<double> toy_free_lifetime;
+
+    // Quantile q of the toy free lifetime limits, e.g. 0.16 and 0.84 for a 68% band
+    double quantile(double q) const {
+        if (toy_free_lifetime.empty()) return nominal.free_lifetime;
+        double pos = q * (toy_free_lifetime.size() - 1);
+        size_t i = std::min<size_t>(pos, toy_free_lifetime.size() - 1);
+        size_t j = std::min(i + 1, toy_free_lifetime.size() - 1);
+        return toy_free_lifetime[i] + (pos - i) * (toy_free_lifetime[j] - toy_free_lifetime[i]);
+    }
+};
+
+// Working point and lifetime limit with ntoys bootstrap toys on nthreads threads (0 uses all cores)
+// The background rate at the working point is fixed by target_bkg_eff, the toys vary the signal efficiency
+inline LimitBand lifetimeLimitBand(const double *sig_score, const double *sig_weight, Long64_t nsig,
+                                   const double *bkg_score, const double *bkg_weight, Long64_t nbkg,
+                                   const SensitivityParams &params, int ntoys = 1000, int nthreads = 0, ULong64_t seed = 88) {
+    ScoredEvents events = sortScores(sig_score, sig_weight, nsig, bkg_score, bkg_weight, nbkg);
+
+    LimitBand band;
+    band.wp = workingPoint(efficiencyCurve(events), params.target_bkg_eff);
+    band.nominal = lifetimeLimit(band.wp.sig_eff, band.wp.bkg_eff, params);
+
+    // The limit on n_s only depends on the background, the toys only change the signal efficiency
+    band.toy_free_lifetime.resize(ntoys);
+    if (nthreads <= 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+    nthreads = std::max(1, std::min(nthreads, ntoys));
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        std::vector<int> count(events.score.size());
+        for (int toy = next++; toy < ntoys; toy = next++) {
+            std::seed_seq seq{(UInt_t)seed, (UInt_t)(seed >> 32), (UInt_t)toy};
+            std::mt19937_64 rng(seq);
+            std::poisson_distribution<int> poisson(1.0);
+            for (int &c : count) c = poisson(rng);
+            WorkingPoint wp = workingPoint(efficiencyCurve(events, &count), params.target_bkg_eff);
+            double rate = band.nominal.n_s / (params.n_neutrons * params.years * params.eff_precut * wp.sig_eff);
+            band.toy_free_lifetime[toy] = std::sqrt(1 / rate / params.R);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int t = 0; t < nthreads; t++) workers.emplace_back(worker);
+    for (std::thread &t : workers) t.join();
+    std::sort(band.toy_free_lifetime.begin(), band.toy_free_lifetime.end());
+    return band;
+}
+
+inline void printLimitBand(const LimitBand &band, const std::string &label) {
+    std::cout << label << ": signal efficiency " << band.wp.sig_eff * 100 << "% at background efficiency " << band.wp.bkg_eff * 100
+              << "% (BDT score >= " << band.wp.threshold << ")" << std::endl;
+    std::cout << label << ": n_b = " << band.nominal.n_b << ", upper limit n_s = " << band.nominal.n_s << std::endl;
+    std::cout << label << ": bound nnbar lifetime limit " << band.nominal.bound_lifetime << " yrs, free nnbar lifetime limit "
+              << band.nominal.free_lifetime << " s" << std::endl;
+    if (!band.toy_free_lifetime.empty()) {
+        std::cout << label << ": " << band.toy_free_lifetime.size() << " bootstrap toys, free lifetime limit 68% band ["
+                  << band.quantile(0.16) << ", " << band.quantile(0.84) << "] s, 95% band [" << band.quantile(0.025) << ", "
+                  << band.quantile(0.975) << "] s" << std::endl;
+    }
+}
+
+#endif
@@ -0,0 +1,279 @@
+// syntheticTrees.h writes synthetic analysistree events for benchmarking, see genSyntheticTrees.C and benchmark.C
+// The trees use the branch names, types and array shapes of the analysistree branches read by the analysis macros
+// Events are not physical, they only need the same sizes and value ranges so the macros do the same work per event
+// The number of events, tracks and showers per event, and hits per track and plane are set in SyntheticConfig
+// A fraction of tracks and showers fail the quality cuts of calcFeatures.C and some hits have dE/dx > 100, so every branch of the feature calculation is taken
+// The weight file for calcWeights.C holds the truth vertex of every event plus unrelated vertices, in the branches mc.nuvtxx/y/z and weight
+
+#ifndef SYNTHETICTREES_H
+#define SYNTHETICTREES_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <TFile.h>
+#include <TTree.h>
+#include <TRandom3.h>
+#include "weightMatch.h"
+
+// Event content of a synthetic sample
+struct SyntheticConfig {
+    Long64_t nevents = 1000;
+    double mean_tracks = 2;         // Poisson mean of the reconstructed tracks per event
+    double mean_showers = 1.5;      // Poisson mean of the reconstructed showers per event
+    int max_particles = 20;         // PFParticles per event are capped here
+    double mean_hits = 200;         // Poisson mean of the hits per track and plane
+    int nwires = 2000;              // wires per plane of the hit arrays, 2000 in the analysistree
+    double proton_fraction = 0.3;   // tracks with proton-like PID and dE/dx
+    double bad_fraction = 0.02;     // tracks and showers with a negative momentum or energy
+    bool nu_primary = true;         // first Geant4 primary is a neutrino (atm) instead of a pion (nnbar)
+    int weight_factor = 2;          // entries of the weight file per event
+    UInt_t seed = 1;
+};
+
+// Vertices are drawn uniformly in a box of the size of the 1x2x6 workspace, cm
+const Float_t kSynthMin[3] = {-360, -600, 0};
+const Float_t kSynthMax[3] = {360, 600, 1390};
+
+// Distance between hits along a track, cm
+const Float_t kSynthPitch = 0.48;
+
+// Random unit vector
+inline void synthDirection(TRandom3 &rng, Float_t dir[3]) {
+    double cost = rng.Uniform(-1, 1);
+    double sint = std::sqrt(1 - cost*cost);
+    double phi = rng.Uniform(0, 2*M_PI);
+    dir[0] = sint * std::cos(phi);
+    dir[1] = sint * std::sin(phi);
+    dir[2] = cost;
+}
+
+// Write cfg.nevents events to the tree treeName of fileName, the truth vertex of each event is added to vertices if given
+// Returns the uncompressed size of the tree, or -1 if the file cannot be written
+inline Long64_t writeSyntheticTree(const std::string &fileName, const std::string &treeName, const SyntheticConfig &cfg,
+                                   WeightTable *vertices = nullptr) {
+    TFile *synthfile = new TFile(fileName.c_str(), "RECREATE");
+    if (synthfile->IsZombie()) {
+        std::cerr << "writeSyntheticTree: cannot write " << fileName << std::endl;
+        delete synthfile;
+        return -1;
+    }
+    TTree *synthtree = new TTree(treeName.c_str(), "synthetic analysistree events");
+    TRandom3 rng(cfg.seed);
+
+    const int maxPFP = std::max(1, cfg.max_particles);
+    const int nwires = std::max(1, cfg.nwires);
+
+    // PFParticles
+    Short_t kPFP;
+    std::vector<Short_t> is_trk(maxPFP);
+    std::vector<Short_t> is_shwr(maxPFP);
+    synthtree->Branch("nPFParticles", &kPFP, "nPFParticles/S");
+    synthtree->Branch("pfp_isTrack", is_trk.data(), "pfp_isTrack[nPFParticles]/S");
+    synthtree->Branch("pfp_isShower", is_shwr.data(), "pfp_isShower[nPFParticles]/S");
+
+    // Tracks, [track][plane] and [track][plane][wire] arrays are stored flat
+    Short_t ktrk;
+    std::vector<Short_t> trk_bestplane(maxPFP);
+    std::vector<Short_t> ktrkhits(maxPFP*3);
+    std::vector<Float_t> trk_len(maxPFP);
+    std::vector<Float_t> trk_thetayz(maxPFP);
+    std::vector<Float_t> trk_momrange(maxPFP);
+    std::vector<Float_t> trk_start_xhat(maxPFP);
+    std::vector<Float_t> trk_start_yhat(maxPFP);
+    std::vector<Float_t> trk_start_zhat(maxPFP);
+    std::vector<Float_t> trk_pida(maxPFP*3);
+    std::vector<Float_t> trk_chipr(maxPFP*3);
+    std::vector<Float_t> trk_chimu(maxPFP*3);
+    std::vector<Float_t> trk_chipi(maxPFP*3);
+    std::vector<Int_t> trk_pdgtruth(maxPFP*3);
+    std::vector<Float_t> trk_dedx((size_t)maxPFP*3*nwires);
+    std::vector<Float_t> trk_xyz((size_t)maxPFP*3*nwires*3);
+    synthtree->Branch("ntracks_pandoraTrack", &ktrk, "ntracks_pandoraTrack/S");
+    synthtree->Branch("trkpidbestplane_pandoraTrack", trk_bestplane.data(), "trkpidbestplane_pandoraTrack[ntracks_pandoraTrack]/S");
+    synthtree->Branch("ntrkhits_pandoraTrack", ktrkhits.data(), "ntrkhits_pandoraTrack[ntracks_pandoraTrack][3]/S");
+    synthtree->Branch("trklen_pandoraTrack", trk_len.data(), "trklen_pandoraTrack[ntracks_pandoraTrack]/F");
+    synthtree->Branch("trkthetayz_pandoraTrack", trk_thetayz.data(), "trkthetayz_pandoraTrack[ntracks_pandoraTrack]/F");
+    synthtree->Branch("trkmomrange_pandoraTrack", trk_momrange.data(), "trkmomrange_pandoraTrack[ntracks_pandoraTrack]/F");
+    synthtree->Branch("trkstartdcosx_pandoraTrack", trk_start_xhat.data(), "trkstartdcosx_pandoraTrack[ntracks_pandoraTrack]/F");
+    synthtree->Branch("trkstartdcosy_pandoraTrack", trk_start_yhat.data(), "trkstartdcosy_pandoraTrack[ntracks_pandoraTrack]/F");
+    synthtree->Branch("trkstartdcosz_pandoraTrack", trk_start_zhat.data(), "trkstartdcosz_pandoraTrack[ntracks_pandoraTrack]/F");
+    synthtree->Branch("trkpidpida_pandoraTrack", trk_pida.data(), "trkpidpida_pandoraTrack[ntracks_pandoraTrack][3]/F");
+    synthtree->Branch("trkpidchipr_pandoraTrack", trk_chipr.data(), "trkpidchipr_pandoraTrack[ntracks_pandoraTrack][3]/F");
+    synthtree->Branch("trkpidchimu_pandoraTrack", trk_chimu.data(), "trkpidchimu_pandoraTrack[ntracks_pandoraTrack][3]/F");
+    synthtree->Branch("trkpidchipi_pandoraTrack", trk_chipi.data(), "trkpidchipi_pandoraTrack[ntracks_pandoraTrack][3]/F");
+    synthtree->Branch("trkpdgtruth_pandoraTrack", trk_pdgtruth.data(), "trkpdgtruth_pandoraTrack[ntracks_pandoraTrack][3]/I");
+    synthtree->Branch("trkdedx_pandoraTrack", trk_dedx.data(), Form("trkdedx_pandoraTrack[ntracks_pandoraTrack][3][%d]/F", nwires));
+    synthtree->Branch("trkxyz_pandoraTrack", trk_xyz.data(), Form("trkxyz_pandoraTrack[ntracks_pandoraTrack][3][%d][3]/F", nwires));
+
+    // Showers
+    Short_t kshwr;
+    std::vector<Short_t> shwr_bestplane(maxPFP);
+    std::vector<Float_t> shwr_totEng(maxPFP*3);
+    std::vector<Float_t> shwr_start_xhat(maxPFP);
+    std::vector<Float_t> shwr_start_yhat(maxPFP);
+    std::vector<Float_t> shwr_start_zhat(maxPFP);
+    synthtree->Branch("nshowers_pandoraShower", &kshwr, "nshowers_pandoraShower/S");
+    synthtree->Branch("shwr_bestplane_pandoraShower", shwr_bestplane.data(), "shwr_bestplane_pandoraShower[nshowers_pandoraShower]/S");
+    synthtree->Branch("shwr_totEng_pandoraShower", shwr_totEng.data(), "shwr_totEng_pandoraShower[nshowers_pandoraShower][3]/F");
+    synthtree->Branch("shwr_startdcosx_pandoraShower", shwr_start_xhat.data(), "shwr_startdcosx_pandoraShower[nshowers_pandoraShower]/F");
+    synthtree->Branch("shwr_startdcosy_pandoraShower", shwr_start_yhat.data(), "shwr_startdcosy_pandoraShower[nshowers_pandoraShower]/F");
+    synthtree->Branch("shwr_startdcosz_pandoraShower", shwr_start_zhat.data(), "shwr_startdcosz_pandoraShower[nshowers_pandoraShower]/F");
+
+    // Neutrino vertex, one per event
+    Short_t nnuvtx = 1;
+    Float_t vtx[3], vtx_truth[3];
+    synthtree->Branch("nnuvtx", &nnuvtx, "nnuvtx/S");
+    synthtree->Branch("nuvtxx", &vtx[0], "nuvtxx[nnuvtx]/F");
+    synthtree->Branch("nuvtxy", &vtx[1], "nuvtxy[nnuvtx]/F");
+    synthtree->Branch("nuvtxz", &vtx[2], "nuvtxz[nnuvtx]/F");
+    synthtree->Branch("nuvtxx_truth", &vtx_truth[0], "nuvtxx_truth[nnuvtx]/F");
+    synthtree->Branch("nuvtxy_truth", &vtx_truth[1], "nuvtxy_truth[nnuvtx]/F");
+    synthtree->Branch("nuvtxz_truth", &vtx_truth[2], "nuvtxz_truth[nnuvtx]/F");
+
+    // Geant4 primaries, the neutrino or pion followed by one primary per PFParticle
+    Int_t geant_list_size;
+    Int_t no_primaries;
+    std::vector<Int_t> process_primary(maxPFP + 1);
+    std::vector<Int_t> pdg(maxPFP + 1);
+    std::vector<Float_t> eng(maxPFP + 1);
+    synthtree->Branch("geant_list_size", &geant_list_size, "geant_list_size/I");
+    synthtree->Branch("no_primaries", &no_primaries, "no_primaries/I");
+    synthtree->Branch("process_primary", process_primary.data(), "process_primary[geant_list_size]/I");
+    synthtree->Branch("pdg", pdg.data(), "pdg[geant_list_size]/I");
+    synthtree->Branch("Eng", eng.data(), "Eng[geant_list_size]/F");
+
+    const double trk_prob = cfg.mean_tracks / std::max(cfg.mean_tracks + cfg.mean_showers, 1e-9);
+
+    for (Long64_t en = 0; en < cfg.nevents; en++) {
+        for (int i = 0; i < 3; i++) {
+            vtx_truth[i] = rng.Uniform(kSynthMin[i], kSynthMax[i]);
+            vtx[i] = vtx_truth[i] + rng.Gaus(0, 1);
+        }
+        if (vertices) {
+            vertices->x.push_back(vtx_truth[0]);
+            vertices->y.push_back(vtx_truth[1]);
+            vertices->z.push_back(vtx_truth[2]);
+            vertices->weight.push_back(1);
+        }
+
+        // Tracks and showers are interleaved in the PFParticle list
+        kPFP = std::min(rng.Poisson(cfg.mean_tracks + cfg.mean_showers), maxPFP);
+        ktrk = 0;
+        kshwr = 0;
+        geant_list_size = kPFP + 1;
+        no_primaries = geant_list_size;
+        process_primary[0] = 1;
+        pdg[0] = cfg.nu_primary ? ((rng.Uniform() < 0.5) ? 14 : 12) * ((rng.Uniform() < 0.3) ? -1 : 1) : 211;
+        eng[0] = cfg.nu_primary ? rng.Exp(1.5) : rng.Uniform(0.1, 1);  // GeV
+
+        for (int ipfp = 0; ipfp < kPFP; ipfp++) {
+            Float_t dir[3];
+            synthDirection(rng, dir);
+            bool bad = rng.Uniform() < cfg.bad_fraction;
+            process_primary[ipfp + 1] = 1;
+            is_trk[ipfp] = rng.Uniform() < trk_prob;
+            is_shwr[ipfp] = !is_trk[ipfp];
+
+            if (is_trk[ipfp]) {
+                int k = ktrk++;
+                bool proton = rng.Uniform() < cfg.proton_fraction;
+                trk_bestplane[k] = rng.Integer(3);
+                trk_momrange[k] = bad ? -999 : rng.Exp(proton ? 0.4 : 0.3);  // GeV
+                trk_start_xhat[k] = dir[0];
+                trk_start_yhat[k] = dir[1];
+                trk_start_zhat[k] = dir[2];
+                trk_thetayz[k] = std::atan2(dir[1], dir[2]);
+                pdg[ipfp + 1] = proton ? 2212 : ((rng.Uniform() < 0.5) ? 13 : 211);
+                eng[ipfp + 1] = std::max(trk_momrange[k], 0.f);
+
+                int maxhits = 0;
+                for (int plane = 0; plane < 3; plane++) {
+                    // Some tracks have no collection plane hits so the best plane is used instead
+                    int nhits = (plane == 2 && rng.Uniform() < 0.1) ? 0 : std::min(rng.Poisson(cfg.mean_hits), nwires);
+                    ktrkhits[k*3 + plane] = nhits;
+                    maxhits = std::max(maxhits, nhits);
+                    trk_pida[k*3 + plane] = (nhits == 0) ? -1 : rng.Gaus(proton ? 15 : 7, proton ? 3 : 2);
+                    trk_chipr[k*3 + plane] = std::abs(rng.Gaus(proton ? 1 : 60, 10));
+                    trk_chimu[k*3 + plane] = std::abs(rng.Gaus(proton ? 60 : 1, 10));
+                    trk_chipi[k*3 + plane] = std::abs(rng.Gaus(proton ? 40 : 5, 10));
+                    trk_pdgtruth[k*3 + plane] = pdg[ipfp + 1];
+
+                    // Hits along a straight line from the vertex, the remaining wires stay empty
+                    Float_t *dedx = &trk_dedx[((size_t)k*3 + plane)*nwires];
+                    Float_t *xyz = &trk_xyz[((size_t)k*3 + plane)*nwires*3];
+                    std::fill(dedx, dedx + nwires, 0.f);
+                    std::fill(xyz, xyz + (size_t)nwires*3, 0.f);
+                    for (int ihit = 0; ihit < nhits; ihit++) {
+                        dedx[ihit] = rng.Landau(proton ? 6 : 2, proton ? 1 : 0.2);  // MeV/cm, the tail reaches the dE/dx > 100 cut
+                        for (int i = 0; i < 3; i++) xyz[ihit*3 + i] = vtx[i] + dir[i] * kSynthPitch * ihit + rng.Gaus(0, 0.05);
+                    }
+                }
+                trk_len[k] = maxhits * kSynthPitch;
+            } else {
+                int k = kshwr++;
+                Float_t shwr_eng = rng.Exp(150);  // MeV
+                shwr_bestplane[k] = rng.Integer(3);
+                for (int plane = 0; plane < 3; plane++) {
+                    shwr_totEng[k*3 + plane] = bad ? -999 : shwr_eng * (1 + rng.Gaus(0, 0.05));
+                }
+                shwr_start_xhat[k] = dir[0];
+                shwr_start_yhat[k] = dir[1];
+                shwr_start_zhat[k] = dir[2];
+                pdg[ipfp + 1] = (rng.Uniform() < 0.5) ? 22 : 11;
+                eng[ipfp + 1] = shwr_eng * 1e-3;  // GeV
+            }
+        }
+        synthtree->Fill();
+    }
+
+    Long64_t totbytes = synthtree->GetTotBytes();
+    synthfile->Write();
+    delete synthfile;
+    return totbytes;
+}
+
+// Write the weighted sample for calcWeights.C: every vertex of events, each followed by weight_factor-1 random vertices
+// Returns the number of entries, or -1 if the file cannot be written
+inline Long64_t writeSyntheticWeights(const std::string &fileName, const std::string &treeName, const WeightTable &events,
+                                      const SyntheticConfig &cfg) {
+    TFile *wfile = new TFile(fileName.c_str(), "RECREATE");
+    if (wfile->IsZombie()) {
+        std::cerr << "writeSyntheticWeights: cannot write " << fileName << std::endl;
+        delete wfile;
+        return -1;
+    }
+    TTree *wtree = new TTree(treeName.c_str(), "synthetic weighted vertices");
+    TRandom3 rng(cfg.seed + 1);
+
+    Float_t mcnuvtx[3];
+    Double_t mcweight;
+    wtree->Branch("mc.nuvtxx", &mcnuvtx[0], "mc.nuvtxx/F");
+    wtree->Branch("mc.nuvtxy", &mcnuvtx[1], "mc.nuvtxy/F");
+    wtree->Branch("mc.nuvtxz", &mcnuvtx[2], "mc.nuvtxz/F");
+    wtree->Branch("weight", &mcweight, "weight/D");
+
+    const int factor = std::max(1, cfg.weight_factor);
+    for (Long64_t en = 0; en < events.size(); en++) {
+        for (int j = 0; j < factor; j++) {
+            if (j == 0) {
+                mcnuvtx[0] = events.x[en];
+                mcnuvtx[1] = events.y[en];
+                mcnuvtx[2] = events.z[en];
+            } else {
+                for (int i = 0; i < 3; i++) mcnuvtx[i] = rng.Uniform(kSynthMin[i], kSynthMax[i]);
+            }
+            mcweight = rng.Uniform(0.1, 2);
+            wtree->Fill();
+        }
+    }
+
+    Long64_t nweights = wtree->GetEntries();
+    wfile->Write();
+    delete wfile;
+    return nweights;
+}
+
+#endif
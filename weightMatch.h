@@ -0,0 +1,299 @@
+// weightMatch.h finds the weight of each event by matching its neutrino vertex to a larger weighted sample
+// The weighted sample is read once into memory and indexed with a k-d tree over the vertex position
+// Lookups return the nearest and second nearest weighted vertex, so unmatched and ambiguous events can be reported
+// Ties are broken towards the lower entry number, which is what a linear scan of the weight tree gives
+// calcSampleWeights() is the per-sample body of calcWeights.C, also called by benchmark.C
+
+#ifndef WEIGHTMATCH_H
+#define WEIGHTMATCH_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <TFile.h>
+#include <TTree.h>
+
+// Columns of the larger weighted sample
+struct WeightTable {
+    std::vector<Float_t> x;
+    std::vector<Float_t> y;
+    std::vector<Float_t> z;
+    std::vector<Double_t> weight;
+
+    Long64_t size() const { return weight.size(); }
+};
+
+// Read the vertex and weight branches of the weighted sample in a single pass
+inline bool loadWeightTable(const std::string &fileName, const std::string &treeName, WeightTable &table) {
+    TFile *mergefile = TFile::Open(fileName.c_str());
+    if (!mergefile || mergefile->IsZombie()) {
+        std::cerr << "loadWeightTable: cannot open " << fileName << std::endl;
+        delete mergefile;
+        return false;
+    }
+    TTree *mergetree = (TTree*)mergefile->Get(treeName.c_str());
+    if (!mergetree) {
+        std::cerr << "loadWeightTable: no tree " << treeName << " in " << fileName << std::endl;
+        delete mergefile;
+        return false;
+    }
+
+    Float_t mcnuvtxx;
+    Float_t mcnuvtxy;
+    Float_t mcnuvtxz;
+    Double_t mcweight;
+
+    mergetree->SetBranchStatus("*", 0);
+    mergetree->SetBranchStatus("mc.nuvtxx", 1);
+    mergetree->SetBranchStatus("mc.nuvtxy", 1);
+    mergetree->SetBranchStatus("mc.nuvtxz", 1);
+    mergetree->SetBranchStatus("weight", 1);
+    mergetree->SetBranchAddress("mc.nuvtxx", &mcnuvtxx);
+    mergetree->SetBranchAddress("mc.nuvtxy", &mcnuvtxy);
+    mergetree->SetBranchAddress("mc.nuvtxz", &mcnuvtxz);
+    mergetree->SetBranchAddress("weight", &mcweight);
+
+    Long64_t nweights = mergetree->GetEntries();
+    table.x.resize(nweights);
+    table.y.resize(nweights);
+    table.z.resize(nweights);
+    table.weight.resize(nweights);
+    for (Long64_t wen = 0; wen < nweights; wen++) {
+        mergetree->GetEntry(wen);
+        table.x[wen] = mcnuvtxx;
+        table.y[wen] = mcnuvtxy;
+        table.z[wen] = mcnuvtxz;
+        table.weight[wen] = mcweight;
+    }
+
+    delete mergefile;
+    return true;
+}
+
+// Static k-d tree over the vertices of a WeightTable
+// Points are stored in tree order, node i of a range [lo, hi) is its median (lo+hi)/2
+class VertexIndex {
+public:
+    explicit VertexIndex(const WeightTable &table) : fEntry(table.size()) {
+        std::iota(fEntry.begin(), fEntry.end(), 0);
+        build(0, fEntry.size(), 0, table);
+        fPos.resize(3 * fEntry.size());
+        for (size_t i = 0; i < fEntry.size(); i++) {
+            fPos[3*i] = table.x[fEntry[i]]; fPos[3*i+1] = table.y[fEntry[i]]; fPos[3*i+2] = table.z[fEntry[i]];
+        }
+    }
+
+    // Find the nearest and second nearest entries to (x, y, z), distances are returned squared
+    // second is -1 if the table holds fewer than two entries
+    void nearest(double x, double y, double z, Long64_t &best, double &best_d2, Long64_t &second, double &second_d2) const {
+        best = -1; second = -1;
+        best_d2 = std::numeric_limits<double>::infinity();
+        second_d2 = std::numeric_limits<double>::infinity();
+        const double q[3] = {x, y, z};
+        search(0, fEntry.size(), 0, q, best, best_d2, second, second_d2);
+    }
+
+private:
+    static const size_t kLeafSize = 8;
+
+    std::vector<Long64_t> fEntry;  // weight table entry of each point in tree order
+    std::vector<Float_t> fPos;     // x, y, z of each point in tree order
+
+    void build(size_t lo, size_t hi, int axis, const WeightTable &table) {
+        if (hi - lo <= kLeafSize) return;
+        const std::vector<Float_t> &coord = (axis == 0) ? table.x : (axis == 1) ? table.y : table.z;
+        size_t mid = (lo + hi) / 2;
+        std::nth_element(fEntry.begin() + lo, fEntry.begin() + mid, fEntry.begin() + hi,
+                         [&](Long64_t a, Long64_t b) { return coord[a] < coord[b]; });
+        build(lo, mid, (axis + 1) % 3, table);
+        build(mid + 1, hi, (axis + 1) % 3, table);
+    }
+
+    void consider(size_t i, const double q[3], Long64_t &best, double &best_d2, Long64_t &second, double &second_d2) const {
+        const double dx = q[0] - fPos[3*i], dy = q[1] - fPos[3*i+1], dz = q[2] - fPos[3*i+2];
+        const double d2 = dx*dx + dy*dy + dz*dz;
+        const Long64_t entry = fEntry[i];
+        if (d2 < best_d2 || (d2 == best_d2 && entry < best)) {
+            second = best; second_d2 = best_d2;
+            best = entry; best_d2 = d2;
+        } else if (d2 < second_d2 || (d2 == second_d2 && entry < second)) {
+            second = entry; second_d2 = d2;
+        }
+    }
+
+    void search(size_t lo, size_t hi, int axis, const double q[3],
+                Long64_t &best, double &best_d2, Long64_t &second, double &second_d2) const {
+        if (hi - lo <= kLeafSize) {
+            for (size_t i = lo; i < hi; i++) consider(i, q, best, best_d2, second, second_d2);
+            return;
+        }
+        size_t mid = (lo + hi) / 2;
+        consider(mid, q, best, best_d2, second, second_d2);
+
+        const double delta = q[axis] - fPos[3*mid + axis];
+        const int next = (axis + 1) % 3;
+        if (delta < 0) {
+            search(lo, mid, next, q, best, best_d2, second, second_d2);
+            if (delta*delta <= second_d2) search(mid + 1, hi, next, q, best, best_d2, second, second_d2);
+        } else {
+            search(mid + 1, hi, next, q, best, best_d2, second, second_d2);
+            if (delta*delta <= second_d2) search(lo, mid, next, q, best, best_d2, second, second_d2);
+        }
+    }
+};
+
+// Result of matching one event vertex
+struct VertexMatch {
+    Long64_t entry;    // weight table entry, -1 if the table is empty
+    Float_t dist;      // distance to the matched vertex [cm]
+    bool matched;      // dist within the tolerance
+    bool ambiguous;    // another vertex with a different weight is at the same distance
+};
+
+// Match one vertex to the nearest weighted vertex
+inline VertexMatch matchVertex(const WeightTable &table, const VertexIndex &index, Float_t x, Float_t y, Float_t z, double tolerance) {
+    Long64_t best, second;
+    double best_d2, second_d2;
+    index.nearest(x, y, z, best, best_d2, second, second_d2);
+
+    VertexMatch m;
+    m.entry = best;
+    m.dist = std::sqrt(best_d2);
+    m.matched = (best >= 0) && (m.dist <= tolerance);
+    m.ambiguous = (second >= 0) && (second_d2 == best_d2) && (table.weight[second] != table.weight[best]);
+    return m;
+}
+
+// Weight of an event from its match, scaled by the ratio of weighted vertices to the nentries events of the sample
+inline Double_t matchedWeight(const WeightTable &table, const VertexMatch &m, Long64_t nentries) {
+    Long64_t nweights = table.size();
+    Double_t minweight = (m.entry >= 0) ? table.weight[m.entry] : 9.0e9;
+    return minweight * (nweights / nentries);
+}
+
+// Match every vertex (x[i], y[i], z[i]) to the nearest weighted vertex on nthreads threads (0 uses all cores)
+inline std::vector<VertexMatch> matchVertices(const WeightTable &table, const VertexIndex &index,
+                                              const std::vector<Float_t> &x, const std::vector<Float_t> &y, const std::vector<Float_t> &z,
+                                              double tolerance, int nthreads) {
+    std::vector<VertexMatch> matches(x.size());
+    if (nthreads <= 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+
+    auto work = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) matches[i] = matchVertex(table, index, x[i], y[i], z[i], tolerance);
+    };
+
+    std::vector<std::thread> workers;
+    size_t chunk = (x.size() + nthreads - 1) / nthreads;
+    for (size_t first = 0; first < x.size(); first += chunk) {
+        workers.emplace_back(work, first, std::min(first + chunk, x.size()));
+    }
+    for (std::thread &t : workers) t.join();
+    return matches;
+}
+
+// Print the number of unmatched and ambiguous events and list the first few of each
+inline void reportMatches(const std::vector<VertexMatch> &matches, double tolerance, const std::string &label) {
+    const int max_listed = 10;
+    Long64_t nunmatched = 0;
+    Long64_t nambiguous = 0;
+    for (size_t en = 0; en < matches.size(); en++) {
+        if (!matches[en].matched) {
+            if (nunmatched++ < max_listed) {
+                std::cout << label << " event " << en << " unmatched, nearest weighted vertex at " << matches[en].dist << " cm" << std::endl;
+            }
+        }
+        if (matches[en].ambiguous) {
+            if (nambiguous++ < max_listed) {
+                std::cout << label << " event " << en << " ambiguous, several weighted vertices at " << matches[en].dist << " cm" << std::endl;
+            }
+        }
+    }
+    std::cout << label << ": " << matches.size() - nunmatched << " of " << matches.size() << " events matched within " << tolerance
+              << " cm, " << nunmatched << " unmatched, " << nambiguous << " ambiguous" << std::endl;
+}
+
+// Write the weights of one sample to outFileName, tree "weight" with the branch "Weight"
+// With a weight table each event takes the weight of the weighted vertex nearest its first truth neutrino vertex,
+// scaled by the ratio of weighted to sample events, without one (nullptr) every event has weight 1
+// Returns the number of events, or -1 if the input cannot be read or has no truth neutrino vertex
+inline Long64_t calcSampleWeights(const std::string &inputFileName, const std::string &inputTreeName,
+                                  const WeightTable *weights, const VertexIndex *windex,
+                                  const std::string &outFileName, const std::string &id, double matchTolerance, int nthreads) {
+    // Read data file
+    TFile *outfile = TFile::Open(inputFileName.c_str());
+    TTree *outtree = (outfile && !outfile->IsZombie()) ? (TTree*)outfile->Get(inputTreeName.c_str()) : nullptr;
+    if (!outtree) {
+        std::cerr << "calcSampleWeights: cannot read tree " << inputTreeName << " from " << inputFileName << std::endl;
+        delete outfile;
+        return -1;
+    }
+    if (weights && !outtree->GetBranch("nuvtxx_truth")) {
+        std::cerr << "calcSampleWeights: no truth neutrino vertex (nuvtxx_truth) in " << inputFileName << ", cannot find the " << id << " weights" << std::endl;
+        delete outfile;
+        return -1;
+    }
+
+    // Create new file for the weights
+    TFile *wfile = new TFile(outFileName.c_str(), "RECREATE");
+    TTree *wtree = new TTree("weight", Form("%s normalized weights no cut applied", id.c_str()));
+
+    // Define variable for weights in weight file
+    Double_t weight;
+    wtree->Branch("Weight", &weight);
+
+    Long64_t nentries = outtree->GetEntries();
+    if (weights) {
+        // Define vars for indexing data file
+        Short_t nnuvtx;
+        int max_knuvtx = std::max(1.0, outtree->GetMaximum("nnuvtx"));
+        std::vector<Float_t> nuvtxx(max_knuvtx);
+        std::vector<Float_t> nuvtxy(max_knuvtx);
+        std::vector<Float_t> nuvtxz(max_knuvtx);
+
+        outtree->SetBranchStatus("*", 0);
+        outtree->SetBranchStatus("nnuvtx", 1);
+        outtree->SetBranchStatus("nuvtx*_truth", 1);
+        outtree->SetBranchAddress("nnuvtx", &nnuvtx);
+        outtree->SetBranchAddress("nuvtxx_truth", nuvtxx.data());
+        outtree->SetBranchAddress("nuvtxy_truth", nuvtxy.data());
+        outtree->SetBranchAddress("nuvtxz_truth", nuvtxz.data());
+
+        // Read the first neutrino vertex of every event
+        std::vector<Float_t> vtxx(nentries);
+        std::vector<Float_t> vtxy(nentries);
+        std::vector<Float_t> vtxz(nentries);
+        for (Long64_t en = 0; en < nentries; en++) {
+            outtree->GetEntry(en);
+            vtxx[en] = nuvtxx[0];
+            vtxy[en] = nuvtxy[0];
+            vtxz[en] = nuvtxz[0];
+        }
+
+        // Find minimum 3D distance in nu vertex between files
+        std::vector<VertexMatch> matches = matchVertices(*weights, *windex, vtxx, vtxy, vtxz, matchTolerance, nthreads);
+        reportMatches(matches, matchTolerance, id);
+
+        for (Long64_t en = 0; en < nentries; en++) {
+            weight = matchedWeight(*weights, matches[en], nentries);
+            wtree->Fill();
+        }
+    } else {
+        weight = 1;
+        for (Long64_t en = 0; en < nentries; en++) {
+            wtree->Fill();
+        }
+    }
+
+    // Write the new tree to the file
+    wfile->Write();
+    delete wfile;
+    delete outfile;
+    return nentries;
+}
+
+#endif